@@ -0,0 +1,82 @@
+// Collect SimPoint basic block vectors by running a program on the ISS.
+//
+//   bbv_profile [-n INTERVAL] <image> <output.bb>
+//
+// -n INTERVAL  committed instructions per interval (default 1000000)
+//
+// Each line of the output is one interval in SimPoint's frequency vector
+// format, "T:<block id>:<instructions> :<block id>:<instructions> ...",
+// and simpoint.py clusters them into the intervals worth simulating.
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+#include "iss.h"
+
+int memory_debug = 0; // referenced by memory.cpp
+
+int main(int argc, char **argv)
+{
+    int opt;
+    uint64_t interval = 1000000;
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            interval = std::stoull(optarg);
+            break;
+        default:
+            std::cerr << "Usage: " << argv[0] << " [-n interval] <image> <output.bb>" << std::endl;
+            return -1;
+        }
+    }
+    if (argc - optind != 2 || interval == 0)
+    {
+        std::cerr << "Usage: " << argv[0] << " [-n interval] <image> <output.bb>" << std::endl;
+        return -1;
+    }
+
+    std::string const image(argv[optind]), output(argv[optind + 1]);
+    Iss iss;
+    if (!iss.load(image.c_str()))
+    {
+        std::cerr << "Failed to load image: " << image << std::endl;
+        return -1;
+    }
+    std::ofstream out(output);
+    if (!out)
+    {
+        std::cerr << "Failed to open file: " << output << std::endl;
+        return -1;
+    }
+
+    std::vector<uint64_t> bbv;
+    iss.bbv = &bbv;
+
+    auto const start = std::chrono::steady_clock::now();
+    uint64_t intervals = 0;
+    while (!iss.done)
+    {
+        if (iss.run(interval) == 0)
+            break;
+
+        out << "T";
+        for (size_t id = 1; id < bbv.size(); id++)
+        {
+            if (bbv[id])
+                out << ":" << id << ":" << bbv[id] << " ";
+        }
+        out << "\n";
+        std::fill(bbv.begin(), bbv.end(), 0);
+        intervals++;
+    }
+    double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << image << " -> " << output << ": " << iss.committed << " instructions, "
+              << intervals << " intervals of " << interval << ", " << (bbv.empty() ? 0 : bbv.size() - 1) << " blocks ("
+              << seconds << " s)" << std::endl;
+    return iss.done ? 0 : -1;
+}
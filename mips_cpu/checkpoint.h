@@ -0,0 +1,41 @@
+#ifndef __INC__CHECKPOINT_H__
+#define __INC__CHECKPOINT_H__
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <type_traits>
+
+// Raw binary (de)serialization for checkpoints. Only plain data is written
+// as-is; a checkpoint is restored by the same build on the same host.
+
+template <typename T>
+void checkpoint_put(std::ostream &os, const T &value)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "checkpoint_put needs plain data");
+    os.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+bool checkpoint_get(std::istream &is, T &value)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "checkpoint_get needs plain data");
+    return bool(is.read(reinterpret_cast<char *>(&value), sizeof(T)));
+}
+
+static inline void checkpoint_put(std::ostream &os, const std::string &value)
+{
+    checkpoint_put(os, uint32_t(value.size()));
+    os.write(value.data(), value.size());
+}
+
+static inline bool checkpoint_get(std::istream &is, std::string &value)
+{
+    uint32_t size;
+    if (!checkpoint_get(is, size))
+        return false;
+    value.resize(size);
+    return bool(is.read(&value[0], size));
+}
+
+#endif
@@ -0,0 +1,24 @@
+#!/bin/bash
+set -e
+# Check that a run resumed from a checkpoint reports what an uninterrupted
+# run does: cycles, stats and occupancy. Needs a model built with
+# make verilate SAVABLE=1.
+# Usage: ./checkpoint_test.sh [benchmark] [cycle]
+benchmark=${1:-quickSort}
+cycle=${2:-20000}
+sim=${SIM:-obj_dir/Vmips_core}
+
+# Everything from the totals up to the host timings, which always differ
+report() {
+    sed -n '/^Total time:/,/^== Host/p' | grep -v '^== Host'
+}
+
+$sim -s -C $cycle -b $benchmark | report > $benchmark.full.report
+$sim -s -R $benchmark.$cycle.ckpt -b $benchmark | report > $benchmark.resumed.report
+if diff $benchmark.full.report $benchmark.resumed.report; then
+    echo "checkpoint_test passed"
+    rm -f $benchmark.full.report $benchmark.resumed.report $benchmark.$cycle.ckpt
+else
+    echo "checkpoint_test failed: $benchmark resumed at cycle $cycle differs" >&2
+    exit 1
+fi
@@ -0,0 +1,357 @@
+#include <algorithm>
+#include <iomanip>
+
+#include "iss.h"
+
+static inline uint32_t sign_extend16(uint32_t raw) { return uint32_t(int32_t(int16_t(raw & 0xffff))); }
+static inline uint32_t zero_extend16(uint32_t raw) { return raw & 0xffff; }
+
+// Branch target as computed by the decoder: pc + 4 + (offset << 2)
+static inline uint32_t branch_target(uint32_t raw, uint32_t pc)
+{
+    return (pc + 4 + (sign_extend16(raw) << 2)) & Iss::ADDR_MASK;
+}
+
+IssOp Iss::decode(uint32_t raw, uint32_t pc)
+{
+    uint8_t const rs = (raw >> 21) & 31;
+    uint8_t const rt = (raw >> 16) & 31;
+    uint8_t const rd = (raw >> 11) & 31;
+    uint32_t const shamt = (raw >> 6) & 31;
+
+    switch (raw >> 26)
+    {
+    case 0x00:
+        switch (raw & 0x3f)
+        {
+        case 0x20: return {INS_ADD,  rs, rt, rd, 0};
+        case 0x21: return {INS_ADDU, rs, rt, rd, 0};
+        case 0x22: return {INS_SUB,  rs, rt, rd, 0};
+        case 0x23: return {INS_SUBU, rs, rt, rd, 0};
+        case 0x24: return {INS_AND,  rs, rt, rd, 0};
+        case 0x25: return {INS_OR,   rs, rt, rd, 0};
+        case 0x26: return {INS_XOR,  rs, rt, rd, 0};
+        case 0x27: return {INS_NOR,  rs, rt, rd, 0};
+        case 0x00: return {INS_SLL,  0,  rt, rd, shamt};
+        case 0x02: return {INS_SRL,  0,  rt, rd, shamt};
+        case 0x03: return {INS_SRA,  0,  rt, rd, shamt};
+        case 0x04: return {INS_SLLV, rs, rt, rd, 0};
+        case 0x06: return {INS_SRLV, rs, rt, rd, 0};
+        case 0x07: return {INS_SRAV, rs, rt, rd, 0};
+        case 0x2a: return {INS_SLT,  rs, rt, rd, 0};
+        case 0x2b: return {INS_SLTU, rs, rt, rd, 0};
+        case 0x08: return {INS_JR,   rs, 0,  0,  0};
+        case 0x09: return {INS_JALR, rs, 0,  31, pc + 8};
+        default:   return {INS_INVALID, 0, 0, 0, 0};
+        }
+    case 0x08: return {INS_ADDI,  rs, 0, rt, sign_extend16(raw)};
+    case 0x09: return {INS_ADDIU, rs, 0, rt, sign_extend16(raw)};
+    case 0x0c: return {INS_ANDI,  rs, 0, rt, zero_extend16(raw)};
+    case 0x0d: return {INS_ORI,   rs, 0, rt, zero_extend16(raw)};
+    case 0x0e: return {INS_XORI,  rs, 0, rt, zero_extend16(raw)};
+    case 0x0a: return {INS_SLTI,  rs, 0, rt, sign_extend16(raw)};
+    case 0x0b: return {INS_SLTIU, rs, 0, rt, sign_extend16(raw)};
+    case 0x0f: return {INS_LUI,   0,  0, rt, raw << 16};
+    case 0x04: return {INS_BEQ,   rs, rt, 0, branch_target(raw, pc)};
+    case 0x05: return {INS_BNE,   rs, rt, 0, branch_target(raw, pc)};
+    case 0x06: return {INS_BLEZ,  rs, 0,  0, branch_target(raw, pc)};
+    case 0x07: return {INS_BGTZ,  rs, 0,  0, branch_target(raw, pc)};
+    case 0x01: return {(raw >> 16) & 1 ? INS_BGEZ : INS_BLTZ, rs, 0, 0, branch_target(raw, pc)};
+    case 0x02: return {INS_J,     0,  0, 0,  (raw << 2) & ADDR_MASK};
+    case 0x03: return {INS_JAL,   0,  0, 31, (raw << 2) & ADDR_MASK};
+    case 0x23: return {INS_LW,    rs, 0, rt, sign_extend16(raw)};
+    case 0x2b: return {INS_SW,    rs, rt, 0, sign_extend16(raw)};
+    case 0x10:
+        // mtc0 $23/$24/$25 report pass/fail/done, anything else is dropped
+        if (rd >= 23 && rd <= 25)
+            return {INS_MTC0, 0, rt, 0, uint32_t(rd - 22)};
+        return {INS_INVALID, 0, 0, 0, 0};
+    default:
+        return {INS_INVALID, 0, 0, 0, 0};
+    }
+}
+
+IssStep Iss::step()
+{
+    IssStep s;
+    for (;;)
+    {
+        uint32_t raw = mem.read(pc >> 2);
+        IssOp op = decode(raw, pc);
+        if (op.ins != INS_INVALID)
+        {
+            execute(op, s);
+            return s;
+        }
+        pc = (pc + 4) & ADDR_MASK;
+    }
+}
+
+// Result of the instructions that neither branch nor access memory
+static inline uint32_t alu(const IssOp &op, uint32_t a, uint32_t b)
+{
+    switch (op.ins)
+    {
+    case INS_ADD:
+    case INS_ADDU:  return a + b;
+    case INS_SUB:
+    case INS_SUBU:  return a - b;
+    case INS_AND:   return a & b;
+    case INS_OR:    return a | b;
+    case INS_XOR:   return a ^ b;
+    case INS_NOR:   return ~(a | b);
+    case INS_SLL:   return b << op.imm;
+    case INS_SRL:   return b >> op.imm;
+    case INS_SRA:   return uint32_t(int32_t(b) >> op.imm);
+    case INS_SLLV:  return b << (a & 31);
+    case INS_SRLV:  return b >> (a & 31);
+    case INS_SRAV:  return uint32_t(int32_t(b) >> (a & 31));
+    case INS_SLT:   return int32_t(a) < int32_t(b);
+    case INS_SLTU:  return a < b;
+    case INS_ADDI:
+    case INS_ADDIU: return a + op.imm;
+    case INS_ANDI:  return a & op.imm;
+    case INS_ORI:   return a | op.imm;
+    case INS_XORI:  return a ^ op.imm;
+    case INS_SLTI:  return int32_t(a) < int32_t(op.imm);
+    case INS_SLTIU: return a < op.imm;
+    case INS_LUI:   return op.imm;
+    default:        return 0;
+    }
+}
+
+static inline bool ends_block(Instruction ins)
+{
+    switch (ins)
+    {
+    case INS_J:   case INS_JAL: case INS_JR:   case INS_JALR:
+    case INS_BEQ: case INS_BNE: case INS_BLEZ: case INS_BGTZ:
+    case INS_BGEZ: case INS_BLTZ:
+    case INS_MTC0:
+        return true;
+    default:
+        return false;
+    }
+}
+
+IssBlock *Iss::translate(uint32_t start)
+{
+    std::unique_ptr<IssBlock> b(new IssBlock);
+    b->pc = start;
+    b->id = block_ids.emplace(start, block_ids.size() + 1).first->second;
+
+    // Bound the scan so a jump into unused memory still ends a block
+    uint32_t addr = start;
+    for (unsigned scanned = 0; scanned < 4 * BLOCK_MAX_OPS && b->ops.size() < BLOCK_MAX_OPS; scanned++)
+    {
+        IssOp op = decode(mem.read(addr >> 2), addr);
+        uint32_t const at = addr;
+        addr = (addr + 4) & ADDR_MASK;
+        if (op.ins == INS_INVALID)
+            continue;
+        b->ops.push_back(op);
+        b->pcs.push_back(at);
+        code_pages[at >> CODE_PAGE_BITS] = true;
+        if (ends_block(op.ins))
+            break;
+    }
+    b->end = addr;
+
+    IssBlock *raw = b.get();
+    blocks[start] = std::move(b);
+    return raw;
+}
+
+IssBlock *Iss::lookup(uint32_t start)
+{
+    auto it = blocks.find(start);
+    return it != blocks.end() ? it->second.get() : translate(start);
+}
+
+IssBlock *Iss::successor(IssBlock *b)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        if (b->next[i] && b->next_pc[i] == pc)
+            return b->next[i];
+    }
+    IssBlock *n = lookup(pc);
+    int const slot = b->next[0] ? 1 : 0;
+    b->next_pc[slot] = pc;
+    b->next[slot] = n;
+    return n;
+}
+
+void Iss::flush_blocks()
+{
+    blocks.clear();
+    std::fill(code_pages.begin(), code_pages.end(), false);
+    code_written = false;
+}
+
+uint64_t Iss::run(uint64_t count)
+{
+    uint64_t const start = committed;
+    uint64_t const target = committed + count;
+    IssStep s;
+    IssBlock *b = NULL;
+
+    while (!done && committed < target)
+    {
+        if (b == NULL)
+            b = lookup(pc);
+
+        size_t const n = b->ops.size();
+        if (n == 0)
+        {
+            pc = b->end;
+            b = NULL;
+            continue;
+        }
+        if (target - committed < n)
+        {
+            // Finish instruction by instruction to stop exactly at target
+            step();
+            if (bbv)
+                count_block(b, 1);
+            b = NULL;
+            continue;
+        }
+
+        // Only the last instruction can change control flow or finish the
+        // program, everything before it just updates registers and memory
+        for (size_t i = 0; i + 1 < n; i++)
+        {
+            const IssOp &op = b->ops[i];
+            uint32_t const a = regs[op.rs];
+            if (op.ins == INS_LW)
+                regs[op.rw] = mem.read(((a + op.imm) & ADDR_MASK) >> 2);
+            else if (op.ins == INS_SW)
+            {
+                uint32_t const addr = (a + op.imm) & ADDR_MASK;
+                mem.write(addr >> 2, regs[op.rt]);
+                code_written = code_written || code_pages[addr >> CODE_PAGE_BITS];
+            }
+            else
+                regs[op.rw] = alu(op, a, regs[op.rt]);
+            regs[0] = 0;
+        }
+        committed += n - 1;
+        pc = b->pcs[n - 1];
+        execute(b->ops[n - 1], s);
+        if (bbv)
+            count_block(b, n);
+
+        // Stores into translated code take effect from the next block on
+        if (code_written)
+        {
+            flush_blocks();
+            b = NULL;
+        }
+        else
+            b = successor(b);
+    }
+    return committed - start;
+}
+
+void Iss::execute(const IssOp &op, IssStep &s)
+{
+    uint32_t const a = regs[op.rs];
+    uint32_t const b = regs[op.rt];
+    uint32_t next_pc = (pc + 4) & ADDR_MASK;
+    uint32_t result = 0;
+
+    s.pc = pc;
+    s.ins = op.ins;
+    s.load = s.store = false;
+    s.addr = 0;
+    s.data = 0;
+    s.mtc0 = 0;
+
+    switch (op.ins)
+    {
+    case INS_J:     next_pc = op.imm; break;
+    case INS_JAL:   next_pc = op.imm; result = (pc + 8) & ADDR_MASK; break;
+    case INS_JR:    next_pc = a & ADDR_MASK; break;
+    case INS_JALR:  next_pc = a & ADDR_MASK; result = op.imm; break;
+    case INS_BEQ:   if (a == b) next_pc = op.imm; break;
+    case INS_BNE:   if (a != b) next_pc = op.imm; break;
+    case INS_BLEZ:  if (int32_t(a) <= 0) next_pc = op.imm; break;
+    case INS_BGTZ:  if (int32_t(a) > 0) next_pc = op.imm; break;
+    case INS_BGEZ:  if (int32_t(a) >= 0) next_pc = op.imm; break;
+    case INS_BLTZ:  if (int32_t(a) < 0) next_pc = op.imm; break;
+
+    case INS_LW:
+        s.load = true;
+        s.addr = (a + op.imm) & ADDR_MASK;
+        result = mem.read(s.addr >> 2);
+        s.data = result;
+        break;
+    case INS_SW:
+        s.store = true;
+        s.addr = (a + op.imm) & ADDR_MASK;
+        mem.write(s.addr >> 2, b);
+        s.data = b;
+        code_written = code_written || code_pages[s.addr >> CODE_PAGE_BITS];
+        break;
+    case INS_MTC0:
+        s.mtc0 = op.imm;
+        done = done || op.imm == 3;
+        break;
+
+    default:
+        result = alu(op, a, b);
+        break;
+    }
+
+    s.rw = op.rw;
+    s.value = op.rw ? result : 0;
+    if (op.rw)
+        regs[op.rw] = result;
+
+    pc = next_pc;
+    committed++;
+}
+
+void Iss::save(std::ostream &os) const
+{
+    checkpoint_put(os, pc);
+    checkpoint_put(os, regs);
+    checkpoint_put(os, committed);
+    checkpoint_put(os, done);
+    mem.save(os);
+}
+
+bool Iss::restore(std::istream &is)
+{
+    flush_blocks();
+    return checkpoint_get(is, pc)
+        && checkpoint_get(is, regs)
+        && checkpoint_get(is, committed)
+        && checkpoint_get(is, done)
+        && mem.restore(is);
+}
+
+void Iss::dump_registers(std::ostream &os) const
+{
+    os << std::hex << std::setfill('0');
+    for (int i = 0; i < 32; i++)
+    {
+        os << std::setw(4) << std::setfill(' ') << to_string(Register(i)) << "="
+           << std::setw(8) << std::setfill('0') << regs[i] << ((i % 4 == 3) ? "\n" : "  ");
+    }
+    os << std::dec << std::setfill(' ');
+}
+
+void Iss::dump_memory(std::ostream &os, uint32_t addr, unsigned words) const
+{
+    uint32_t first = (addr & ADDR_MASK & ~3u) - std::min<uint32_t>(addr & ADDR_MASK & ~3u, words / 2 * 4);
+    os << std::hex << std::setfill('0');
+    for (unsigned i = 0; i < words; i++)
+    {
+        uint32_t a = first + 4 * i;
+        os << (a == (addr & ~3u) ? " >" : "  ") << std::setw(8) << a << ": "
+           << std::setw(8) << mem.read(a >> 2) << "\n";
+    }
+    os << std::dec << std::setfill(' ');
+}
@@ -0,0 +1,113 @@
+#ifndef __INC__ISS_H__
+#define __INC__ISS_H__
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "memory.h"
+#include "simulation.h"
+
+// One decoded instruction, in the shape mips_core's decoder produces it
+struct IssOp
+{
+    Instruction ins;
+    uint8_t rs, rt;
+    uint8_t rw;   // destination register, 0 when the instruction writes none
+    uint32_t imm; // extended immediate, shift amount, link address or jump target
+};
+
+// Architectural effect of one committed instruction
+struct IssStep
+{
+    uint32_t pc;
+    Instruction ins;
+    uint8_t rw; // 0 when no register is written
+    uint32_t value;
+    bool load, store;
+    uint32_t addr;
+    uint32_t data; // loaded or stored
+    uint8_t mtc0; // 1 pass, 2 fail, 3 done (as mtc0_t.id), 0 otherwise
+};
+
+// Straight-line run of instructions ending at a jump, branch or mtc0.
+// Invalid encodings are left out, so pcs[] is not always contiguous.
+struct IssBlock
+{
+    uint32_t pc;  // address of the first instruction
+    unsigned id;  // stable across flushes, numbered from 1 (SimPoint ids)
+    uint32_t end; // address after the last instruction
+    std::vector<IssOp> ops;
+    std::vector<uint32_t> pcs;
+
+    // Chained successors, resolved the first time each is taken
+    uint32_t next_pc[2] = {};
+    IssBlock *next[2] = {};
+};
+
+/*
+ * Functional model of the MIPS subset in SIM_ALL_INSTRUCTIONS, matching
+ * mips_core rather than the full architecture: no branch delay slots,
+ * jal/jalr link to pc + 8, 26-bit addresses, and every instruction the
+ * decoder marks invalid is dropped without being committed.
+ */
+class Iss
+{
+public:
+    uint32_t pc = 0;
+    uint32_t regs[32] = {};
+    MemoryStore mem;
+
+    uint64_t committed = 0;
+    bool done = false;
+
+    // When set, run() adds the instructions committed by each block to
+    // (*bbv)[block id], e.g. to collect SimPoint basic block vectors
+    std::vector<uint64_t> *bbv = nullptr;
+
+    bool load(const char *const image_file) { return Memory::load_image(image_file, mem); }
+
+    static IssOp decode(uint32_t raw, uint32_t pc);
+
+    // Run up to and including the next instruction the core would commit
+    IssStep step();
+
+    // Fast-forward: commit count more instructions (fewer if the program
+    // finishes) through the basic block cache. Returns the number committed.
+    uint64_t run(uint64_t count);
+
+    void execute(const IssOp &op, IssStep &s);
+
+    void save(std::ostream &os) const;
+    bool restore(std::istream &is);
+
+    void dump_registers(std::ostream &os) const;
+    void dump_memory(std::ostream &os, uint32_t addr, unsigned words = 8) const;
+
+    static constexpr uint32_t ADDR_MASK = (1u << ADDR_WIDTH) - 1;
+
+private:
+    static constexpr unsigned BLOCK_MAX_OPS = 64;
+    static constexpr unsigned CODE_PAGE_BITS = 12;
+
+    std::unordered_map<uint32_t, std::unique_ptr<IssBlock>> blocks;
+    std::unordered_map<uint32_t, unsigned> block_ids;
+    std::vector<bool> code_pages = std::vector<bool>(1u << (ADDR_WIDTH - CODE_PAGE_BITS));
+    bool code_written = false; // a store hit a translated page
+
+    IssBlock *translate(uint32_t start);
+    IssBlock *lookup(uint32_t start);
+    IssBlock *successor(IssBlock *b);
+    void flush_blocks();
+
+    void count_block(const IssBlock *b, uint64_t n)
+    {
+        if (b->id >= bbv->size())
+            bbv->resize(b->id + 1);
+        (*bbv)[b->id] += n;
+    }
+};
+
+#endif
@@ -0,0 +1,268 @@
+#include <cinttypes>
+#include <cstring>
+
+#include "kanata_log.h"
+#include "simulation.h"
+
+static constexpr const char *stage_names[] = {
+    "F",  // fetch
+    "Dc", // decode
+    "Rn", // renamed, waiting in an instruction queue
+    "Is", // issued, waiting to commit
+    "Cm", // commit
+};
+
+enum { RETIRE = 0, FLUSH = 1 }; // R types
+enum { LABEL = 0, HOVER = 1 };  // L types
+
+bool KanataLog::open(const std::string &file_name)
+{
+    close();
+    f = fopen(file_name.c_str(), "w");
+    if (f == NULL)
+    {
+        std::cerr << "Failed to open file: " << file_name << std::endl;
+        return false;
+    }
+    this->file_name = file_name;
+    started = false;
+    next_id = retired = flushed = 0;
+    fprintf(f, "Kanata\t0004\n");
+    return true;
+}
+
+void KanataLog::advance(uint64_t to)
+{
+    if (!started)
+    {
+        fprintf(f, "C=\t%" PRIu64 "\n", to);
+        started = true;
+    }
+    else if (to > cycle)
+        fprintf(f, "C\t%" PRIu64 "\n", to - cycle);
+    else
+        return;
+    cycle = to;
+
+    // Commit shows for one cycle
+    for (uint64_t id : retiring)
+    {
+        fprintf(f, "E\t%" PRIu64 "\t0\t%s\n", id, stage_names[4]);
+        fprintf(f, "R\t%" PRIu64 "\t%" PRIu64 "\t%d\n", id, retired++, RETIRE);
+    }
+    retiring.clear();
+}
+
+KanataLog::Inflight KanataLog::begin(uint32_t pc)
+{
+    Inflight ins {next_id++, pc, -1};
+    fprintf(f, "I\t%" PRIu64 "\t%" PRIu64 "\t0\n", ins.id, ins.id);
+    char text[16];
+    snprintf(text, sizeof(text), "%08x: ", pc);
+    label(ins, LABEL, text);
+    return ins;
+}
+
+void KanataLog::enter(Inflight &ins, int stage)
+{
+    if (ins.stage >= 0)
+        fprintf(f, "E\t%" PRIu64 "\t0\t%s\n", ins.id, stage_names[ins.stage]);
+    fprintf(f, "S\t%" PRIu64 "\t0\t%s\n", ins.id, stage_names[stage]);
+    ins.stage = stage;
+}
+
+void KanataLog::retire(const Inflight &ins, bool flush)
+{
+    if (!flush)
+    {
+        retiring.push_back(ins.id);
+        return;
+    }
+    if (ins.stage >= 0)
+        fprintf(f, "E\t%" PRIu64 "\t0\t%s\n", ins.id, stage_names[ins.stage]);
+    fprintf(f, "R\t%" PRIu64 "\t%" PRIu64 "\t%d\n", ins.id, ins.id, FLUSH);
+    flushed++;
+}
+
+// Physical registers carry a valid flag in their least significant bit
+void KanataLog::depend(const Inflight &ins, int reg)
+{
+    if (!(reg & 1))
+        return;
+    auto const producer = producers.find(reg >> 1);
+    if (producer == producers.end())
+        return;
+    for (const auto &w : window)
+    {
+        if (w.second.id == producer->second)
+        {
+            fprintf(f, "W\t%" PRIu64 "\t%" PRIu64 "\t0\n", ins.id, producer->second);
+            return;
+        }
+    }
+}
+
+void KanataLog::label(const Inflight &ins, int type, const char *text)
+{
+    fprintf(f, "L\t%" PRIu64 "\t%d\t%s\n", ins.id, type, text);
+}
+
+void KanataLog::fetch(const int *v)
+{
+    uint32_t const pc = v[0];
+    // Fetch repeats while stalled
+    if (!frontend.empty() && frontend.back().stage == 0 && frontend.back().pc == pc)
+        return;
+    frontend.push_back(begin(pc));
+    enter(frontend.back(), 0);
+}
+
+void KanataLog::decode(const int *v)
+{
+    uint32_t const pc = v[0];
+    // So does decode
+    for (auto it = frontend.rbegin(); it != frontend.rend(); ++it)
+    {
+        if (it->stage == 1)
+        {
+            if (it->pc == pc)
+                return;
+            break;
+        }
+    }
+
+    size_t i = 0;
+    while (i < frontend.size() && !(frontend[i].stage == 0 && frontend[i].pc == pc))
+        i++;
+    if (i == frontend.size())
+        frontend.push_back(begin(pc));
+
+    // Fetched instructions the decoded one overtakes were flushed
+    for (size_t j = 0; j < i;)
+    {
+        if (frontend[j].stage == 0)
+        {
+            retire(frontend[j], true);
+            frontend.erase(frontend.begin() + j);
+            i--;
+        }
+        else
+            j++;
+    }
+
+    Inflight &ins = frontend[i];
+    enter(ins, 1);
+    char text[64];
+    snprintf(text, sizeof(text), "%s %s, %s, %s, %d",
+        to_string(Instruction(v[1])), to_string(Register(v[2])),
+        to_string(Register(v[3])), to_string(Register(v[4])), v[5]);
+    label(ins, LABEL, text);
+}
+
+void KanataLog::rename(const int *v)
+{
+    uint32_t const pc = v[0];
+    int const commit_index = v[1];
+
+    // Decoded instructions are renamed in order
+    Inflight ins;
+    auto it = frontend.begin();
+    while (it != frontend.end() && !(it->stage == 1 && it->pc == pc))
+        ++it;
+    if (it == frontend.end())
+        ins = begin(pc);
+    else
+    {
+        while (frontend.begin() != it)
+        {
+            retire(frontend.front(), true);
+            frontend.pop_front();
+        }
+        ins = frontend.front();
+        frontend.pop_front();
+    }
+
+    auto const stale = window.find(commit_index);
+    if (stale != window.end())
+    {
+        retire(stale->second, true);
+        window.erase(stale);
+    }
+
+    enter(ins, 2);
+    depend(ins, v[4]);
+    depend(ins, v[5]);
+    if (v[3] & 1)
+        producers[v[3] >> 1] = ins.id;
+
+    char text[64];
+    if (v[3] & 1)
+        snprintf(text, sizeof(text), "commit index %d, p%d", commit_index, v[3] >> 1);
+    else
+        snprintf(text, sizeof(text), "commit index %d", commit_index);
+    label(ins, HOVER, text);
+    window[commit_index] = ins;
+}
+
+void KanataLog::issue(const int *v)
+{
+    auto const it = window.find(v[1]);
+    if (it != window.end() && it->second.pc == uint32_t(v[0]))
+        enter(it->second, 3);
+}
+
+void KanataLog::commit(const int *v)
+{
+    Inflight ins;
+    auto const it = window.find(v[1]);
+    if (it != window.end() && it->second.pc == uint32_t(v[0]))
+    {
+        ins = it->second;
+        window.erase(it);
+    }
+    else
+        ins = begin(v[0]);
+    enter(ins, 4);
+    retire(ins, false);
+}
+
+// Everything in flight is younger than the mispredicted branch
+void KanataLog::flush()
+{
+    for (const Inflight &ins : frontend)
+        retire(ins, true);
+    frontend.clear();
+    for (const auto &w : window)
+        retire(w.second, true);
+    window.clear();
+    producers.clear();
+}
+
+void KanataLog::record(uint64_t cycle, int stage, const int *fields)
+{
+    advance(cycle);
+    switch (stage)
+    {
+    case 0: fetch(fields); break;
+    case 1: decode(fields); break;
+    case 2: rename(fields); break;
+    case 3: issue(fields); break;
+    case 4: commit(fields); break;
+    case PIPELINE_FLUSH_STAGE: flush(); break;
+    }
+}
+
+void KanataLog::close(std::ostream *os)
+{
+    if (f == nullptr)
+        return;
+    advance(cycle + 1);
+    // Still in flight when the simulation stopped; they end as flushed
+    uint64_t const unfinished = frontend.size() + window.size();
+    flush();
+    fclose(f);
+    f = nullptr;
+    if (os)
+        *os << "Wrote " << next_id << " instructions (" << retired << " committed, "
+            << flushed - unfinished << " flushed) to \"" << file_name << "\"" << std::endl;
+}
@@ -0,0 +1,74 @@
+#ifndef __INC__KANATA_LOG_H__
+#define __INC__KANATA_LOG_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Pipeline stage events (log_pipeline_stage) correlated per dynamic
+ * instruction and written as a Kanata log, the format of the Konata O3
+ * pipeline viewer (https://github.com/shioyadan/Konata).
+ *
+ * The events carry no instruction id, so they are matched the way the
+ * core moves instructions: fetch and decode in order by pc, rename hands
+ * out the commit index, and issue and commit find the instruction by it.
+ * Fetched or decoded instructions that a younger one overtakes were
+ * flushed (a taken prediction at decode), and a flush event (commit of a
+ * mispredicted branch) flushes everything still in flight. Flushed
+ * instructions stay in the log, marked as such.
+ */
+
+class KanataLog
+{
+public:
+    ~KanataLog() { close(); }
+
+    bool open(const std::string &file_name);
+    bool is_open() const { return f != nullptr; }
+
+    // As passed to log_pipeline_stage
+    void record(uint64_t cycle, int stage, const int *fields);
+
+    // Retire what is left and report to os
+    void close(std::ostream *os = nullptr);
+
+private:
+    struct Inflight
+    {
+        uint64_t id;
+        uint32_t pc;
+        int stage; // last stage entered
+    };
+
+    FILE *f = nullptr;
+    std::string file_name;
+    uint64_t cycle = 0;
+    bool started = false;
+
+    uint64_t next_id = 0, retired = 0, flushed = 0;
+    std::deque<Inflight> frontend;                 // fetched or decoded, oldest first
+    std::unordered_map<int, Inflight> window;      // renamed, by commit index
+    std::unordered_map<int, uint64_t> producers;   // physical register -> id of its last writer
+    std::vector<uint64_t> retiring;                // committed this cycle, retired the next
+
+    void advance(uint64_t to);
+    Inflight begin(uint32_t pc);
+    void enter(Inflight &ins, int stage);
+    void retire(const Inflight &ins, bool flush);
+    void depend(const Inflight &ins, int reg);
+    void label(const Inflight &ins, int type, const char *text);
+
+    void fetch(const int *v);
+    void decode(const int *v);
+    void rename(const int *v);
+    void issue(const int *v);
+    void commit(const int *v);
+    void flush();
+};
+
+#endif
@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "latency_profile.h"
+#include "iss.h"
+
+static constexpr const char *span_names[LATENCY_SPANS] = {
+    "wait",
+    "execute",
+    "retire",
+};
+
+static constexpr const char *span_descriptions[LATENCY_SPANS] = {
+    "rename to issue",
+    "issue to complete",
+    "complete to commit",
+};
+
+#define LATENCY_BAR 50
+
+void LatencyProfile::Histogram::add(uint64_t latency)
+{
+    if (latency >= counts.size())
+        counts.resize(latency + 1);
+    counts[latency]++;
+    samples++;
+    sum += latency;
+}
+
+void LatencyProfile::Histogram::merge(const Histogram &other)
+{
+    if (other.counts.size() > counts.size())
+        counts.resize(other.counts.size());
+    for (size_t latency = 0; latency < other.counts.size(); latency++)
+        counts[latency] += other.counts[latency];
+    samples += other.samples;
+    sum += other.sum;
+}
+
+// The smallest latency at least p of the samples are within
+uint64_t LatencyProfile::Histogram::percentile(double p) const
+{
+    uint64_t const target = uint64_t(p * samples + 0.5);
+    uint64_t seen = 0;
+    for (size_t latency = 0; latency < counts.size(); latency++)
+    {
+        seen += counts[latency];
+        if (seen >= target && seen)
+            return latency;
+    }
+    return counts.empty() ? 0 : counts.size() - 1;
+}
+
+void LatencyProfile::reset(const MemoryStore *program)
+{
+    this->program = program;
+    window.clear();
+    classes.clear();
+    for (auto &span : histograms)
+        std::fill(std::begin(span), std::end(span), Histogram());
+}
+
+Instruction LatencyProfile::classify(uint32_t pc)
+{
+    auto it = classes.find(pc);
+    if (it == classes.end())
+        it = classes.emplace(pc, Iss::decode(program->read((pc & Iss::ADDR_MASK) >> 2), pc).ins).first;
+    return it->second;
+}
+
+void LatencyProfile::commit(uint64_t cycle, uint32_t pc, int commit_index)
+{
+    auto const it = window.find(commit_index);
+    if (it == window.end() || it->second.pc != pc)
+        return;
+    const Inflight &ins = it->second;
+    Instruction const c = classify(pc);
+    if (ins.issued)
+        histograms[LATENCY_WAIT][c].add(ins.issued - ins.renamed);
+    if (ins.issued && ins.completed)
+        histograms[LATENCY_EXECUTE][c].add(ins.completed - ins.issued);
+    if (ins.completed)
+        histograms[LATENCY_RETIRE][c].add(cycle - ins.completed);
+    window.erase(it);
+}
+
+void LatencyProfile::record(uint64_t cycle, int stage, const int *fields)
+{
+    uint32_t const pc = fields[0];
+    int const commit_index = fields[1];
+    switch (stage)
+    {
+    case 2: // rename, over whatever was flushed from this entry
+        window[commit_index] = Inflight {pc, cycle};
+        break;
+    case PIPELINE_DISPATCH_STAGE:
+    case 3: // complete
+    {
+        auto const it = window.find(commit_index);
+        if (it == window.end() || it->second.pc != pc)
+            break;
+        (stage == 3 ? it->second.completed : it->second.issued) = cycle;
+        break;
+    }
+    case 4:
+        commit(cycle, pc, commit_index);
+        break;
+    case PIPELINE_FLUSH_STAGE:
+        window.clear();
+        break;
+    }
+}
+
+bool LatencyProfile::write(const std::string &file_name) const
+{
+    std::ofstream os(file_name);
+    if (!os)
+    {
+        std::cerr << "Failed to open file: " << file_name << std::endl;
+        return false;
+    }
+
+    os << std::fixed << std::setprecision(2);
+    for (unsigned s = 0; s < LATENCY_SPANS; s++)
+    {
+        os << (s ? "\n" : "") << "== " << span_names[s] << ": " << span_descriptions[s] << " ====\n"
+           << std::setw(8) << std::left << "class" << std::right << std::setw(12) << "count"
+           << std::setw(10) << "mean" << std::setw(8) << "p50" << std::setw(8) << "p90"
+           << std::setw(8) << "p99" << std::setw(8) << "max" << "\n";
+        auto const row = [&os](const char *label, const Histogram &h) {
+            os << std::setw(8) << std::left << label << std::right << std::setw(12) << h.samples
+               << std::setw(10) << double(h.sum) / h.samples << std::setw(8) << h.percentile(0.5)
+               << std::setw(8) << h.percentile(0.9) << std::setw(8) << h.percentile(0.99)
+               << std::setw(8) << h.counts.size() - 1 << "\n";
+        };
+        Histogram all;
+        for (unsigned c = 0; c < LATENCY_CLASSES; c++)
+        {
+            const Histogram &h = histograms[s][c];
+            if (!h.samples)
+                continue;
+            row(to_string(Instruction(c)), h);
+            all.merge(h);
+        }
+        if (all.samples)
+            row("all", all);
+    }
+
+    // cycles, samples, share of the class and a bar scaled to its largest bucket
+    for (unsigned s = 0; s < LATENCY_SPANS; s++)
+    {
+        os << "\n== " << span_names[s] << " histograms ====\n";
+        for (unsigned c = 0; c < LATENCY_CLASSES; c++)
+        {
+            const Histogram &h = histograms[s][c];
+            if (!h.samples)
+                continue;
+            uint64_t const peak = *std::max_element(h.counts.begin(), h.counts.end());
+            os << to_string(Instruction(c)) << "\n";
+            for (size_t latency = 0; latency < h.counts.size(); latency++)
+            {
+                uint64_t const n = h.counts[latency];
+                if (!n)
+                    continue;
+                os << std::setw(8) << latency << std::setw(12) << n
+                   << std::setw(9) << 100.0 * n / h.samples << "%  "
+                   << std::string((n * LATENCY_BAR + peak - 1) / peak, '#') << "\n";
+            }
+        }
+    }
+    return true;
+}
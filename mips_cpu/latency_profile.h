@@ -0,0 +1,75 @@
+#ifndef __INC__LATENCY_PROFILE_H__
+#define __INC__LATENCY_PROFILE_H__
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "memory.h"
+#include "simulation.h"
+
+/*
+ * Lifetime latency histograms per instruction class (-L).
+ *
+ * The pipeline stage events carry the commit index from rename on, which
+ * finds the instruction again when it issues (dispatch_event, the first
+ * cycle in an execution unit), completes (issue_event) and commits. Each
+ * committed instruction adds its three spans to the histograms of its
+ * class:
+ *   wait     rename to issue, waiting for operands or a free unit
+ *   execute  issue to complete, the execution unit and memory
+ *   retire   complete to commit, waiting for older instructions
+ * Flushed instructions are dropped.
+ */
+
+enum LatencySpan
+{
+    LATENCY_WAIT,
+    LATENCY_EXECUTE,
+    LATENCY_RETIRE,
+    LATENCY_SPANS
+};
+
+#define LATENCY_CLASSES (INS_INVALID + 1)
+
+class LatencyProfile
+{
+public:
+    // program: to classify instructions by their encoding
+    void reset(const MemoryStore *program);
+
+    // As passed to log_pipeline_stage
+    void record(uint64_t cycle, int stage, const int *fields);
+
+    // Summary per span and class, then the histograms
+    bool write(const std::string &file_name) const;
+
+private:
+    struct Inflight
+    {
+        uint32_t pc;
+        uint64_t renamed;
+        uint64_t issued = 0, completed = 0; // 0 until then
+    };
+
+    struct Histogram
+    {
+        std::vector<uint64_t> counts; // by latency in cycles
+        uint64_t samples = 0, sum = 0;
+
+        void add(uint64_t latency);
+        void merge(const Histogram &other);
+        uint64_t percentile(double p) const;
+    };
+
+    const MemoryStore *program = nullptr;
+    std::unordered_map<int, Inflight> window;        // by commit index
+    std::unordered_map<uint32_t, Instruction> classes; // by pc
+    Histogram histograms[LATENCY_SPANS][LATENCY_CLASSES];
+
+    Instruction classify(uint32_t pc);
+    void commit(uint64_t cycle, uint32_t pc, int commit_index);
+};
+
+#endif
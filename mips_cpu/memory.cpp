@@ -1,17 +1,223 @@
 #include <iostream>
 #include <fstream>
+#include <cstring>
+#include <cmath>
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "memory.h"
 
 extern int memory_debug;
 
-Memory::Memory(const char *const hex_file, double delay_factor) : delay_factor(delay_factor)
+Memory::Memory(const char *const image_file, double delay_factor)
+    : write_address_pipe(NULL), write_data_pipe(NULL), read_address_pipe(NULL),
+      write_address_pending(0), write_data_pending(0), read_address_pending(0),
+      delay_factor(delay_factor),
+      read_address_limit(AXI_READ_ADDR_MAX_PENDING), write_address_limit(AXI_WRITE_ADDR_MAX_PENDING),
+      deadline_count(0), read_due(0), write_due(0)
 {
-    std::ifstream f(hex_file);
+    if (!load_image(image_file, m))
+        exit(-1);
+}
+
+void Memory::save(std::ostream &os) const
+{
+    // delay_factor and the limits are configuration, not state
+    m.save(os);
+
+    // The pipe pointers only ever point at their own slot
+    checkpoint_put(os, write_address_pipe != NULL);
+    checkpoint_put(os, write_data_pipe != NULL);
+    checkpoint_put(os, read_address_pipe != NULL);
+    checkpoint_put(os, write_address_slot);
+    checkpoint_put(os, write_data_slot);
+    checkpoint_put(os, read_address_slot);
+
+    checkpoint_put(os, write_address);
+    checkpoint_put(os, write_data);
+    checkpoint_put(os, read_address);
+    checkpoint_put(os, write_address_pending);
+    checkpoint_put(os, write_data_pending);
+    checkpoint_put(os, read_address_pending);
+    checkpoint_put(os, write_response);
+    checkpoint_put(os, read_data);
+
+    checkpoint_put(os, deadlines);
+    checkpoint_put(os, deadline_count);
+    checkpoint_put(os, read_due);
+    checkpoint_put(os, write_due);
+}
+
+uint64_t Memory::next_event_time() const
+{
+    if (write_address_pipe != NULL || write_data_pipe != NULL || read_address_pipe != NULL)
+        return 0;
+    if (read_due || write_due || !write_response.empty() || !read_data.empty())
+        return 0;
+    if (deadline_count == 0)
+        return UINT64_MAX;
+    // process_deadlines() fires at the first integer time not before it
+    return uint64_t(std::ceil(deadlines[0].time));
+}
+
+bool Memory::reload(const char *const image_file)
+{
+    write_address_pipe = NULL;
+    write_data_pipe = NULL;
+    read_address_pipe = NULL;
+    for (int id = 0; id < AXI_ID_COUNT; id++)
+    {
+        write_address[id].clear();
+        write_data[id].clear();
+        read_address[id].clear();
+    }
+    write_address_pending = write_data_pending = read_address_pending = 0;
+    write_response.clear();
+    read_data.clear();
+    deadline_count = 0;
+    read_due = write_due = 0;
+
+    m.clear();
+    return load_image(image_file, m);
+}
+
+bool Memory::restore(std::istream &is)
+{
+    bool write_address_full = false, write_data_full = false, read_address_full = false;
+    bool ok = m.restore(is)
+           && checkpoint_get(is, write_address_full)
+           && checkpoint_get(is, write_data_full)
+           && checkpoint_get(is, read_address_full)
+           && checkpoint_get(is, write_address_slot)
+           && checkpoint_get(is, write_data_slot)
+           && checkpoint_get(is, read_address_slot)
+           && checkpoint_get(is, write_address)
+           && checkpoint_get(is, write_data)
+           && checkpoint_get(is, read_address)
+           && checkpoint_get(is, write_address_pending)
+           && checkpoint_get(is, write_data_pending)
+           && checkpoint_get(is, read_address_pending)
+           && checkpoint_get(is, write_response)
+           && checkpoint_get(is, read_data)
+           && checkpoint_get(is, deadlines)
+           && checkpoint_get(is, deadline_count)
+           && checkpoint_get(is, read_due)
+           && checkpoint_get(is, write_due);
+
+    write_address_pipe = write_address_full ? &write_address_slot : NULL;
+    write_data_pipe = write_data_full ? &write_data_slot : NULL;
+    read_address_pipe = read_address_full ? &read_address_slot : NULL;
+    return ok;
+}
+
+// Read-only view of a whole file through mmap
+struct MappedFile
+{
+    const uint8_t *data = NULL;
+    size_t size = 0;
+
+    bool open(const char *const file_name)
+    {
+        int fd = ::open(file_name, O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                data = static_cast<const uint8_t *>(p);
+                size = st.st_size;
+            }
+        }
+        ::close(fd);
+        return data != NULL;
+    }
+
+    ~MappedFile()
+    {
+        if (data != NULL)
+            munmap(const_cast<uint8_t *>(data), size);
+    }
+};
+
+// Copy bytes into the store as big-endian words starting at byte address addr
+static void load_bytes(MemoryStore &store, uint32_t addr, const uint8_t *bytes, size_t size, bool big_endian)
+{
+    for (size_t i = 0; i < size; i += 4)
+    {
+        uint8_t b[4] = {0, 0, 0, 0};
+        for (size_t j = 0; j < 4 && i + j < size; j++)
+            b[j] = bytes[i + j];
+        uint32_t data = big_endian
+            ? (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | b[3]
+            : (uint32_t(b[3]) << 24) | (uint32_t(b[2]) << 16) | (uint32_t(b[1]) << 8) | b[0];
+        if (memory_debug >= 3)
+            std::cout << "Preload addr=" << std::hex << std::showbase << (addr + i) / 4
+                      << " data=" << data << std::noshowbase << std::endl;
+        store.write((addr + i) / 4, data);
+    }
+}
+
+static bool load_elf(const char *const image_file, const MappedFile &f, MemoryStore &store)
+{
+    if (f.size < sizeof(Elf32_Ehdr) || f.data[EI_CLASS] != ELFCLASS32)
+    {
+        std::cerr << "Not a 32-bit ELF file: " << image_file << std::endl;
+        return false;
+    }
+    bool big_endian = f.data[EI_DATA] == ELFDATA2MSB;
+    auto u16 = [&](const void *p) {
+        auto b = static_cast<const uint8_t *>(p);
+        return big_endian ? uint16_t(b[0] << 8 | b[1]) : uint16_t(b[1] << 8 | b[0]);
+    };
+    auto u32 = [&](const void *p) {
+        auto b = static_cast<const uint8_t *>(p);
+        return big_endian ? uint32_t(b[0]) << 24 | uint32_t(b[1]) << 16 | uint32_t(b[2]) << 8 | b[3]
+                          : uint32_t(b[3]) << 24 | uint32_t(b[2]) << 16 | uint32_t(b[1]) << 8 | b[0];
+    };
+
+    auto ehdr = reinterpret_cast<const Elf32_Ehdr *>(f.data);
+    uint32_t shoff = u32(&ehdr->e_shoff);
+    uint16_t shentsize = u16(&ehdr->e_shentsize);
+    uint16_t shnum = u16(&ehdr->e_shnum);
+    if (shentsize < sizeof(Elf32_Shdr) || shoff + size_t(shnum) * shentsize > f.size)
+    {
+        std::cerr << "Malformed ELF section table: " << image_file << std::endl;
+        return false;
+    }
+
+    // Load every allocated section with contents (.text and .data after
+    // the objcopy in hex_generator/Makefile) at its link address
+    for (int i = 0; i < shnum; i++)
+    {
+        auto shdr = reinterpret_cast<const Elf32_Shdr *>(f.data + shoff + size_t(i) * shentsize);
+        if (u32(&shdr->sh_type) != SHT_PROGBITS || !(u32(&shdr->sh_flags) & SHF_ALLOC))
+            continue;
+        uint32_t addr = u32(&shdr->sh_addr);
+        uint32_t offset = u32(&shdr->sh_offset);
+        uint32_t size = u32(&shdr->sh_size);
+        if (size_t(offset) + size > f.size || addr % 4 != 0)
+        {
+            std::cerr << "Malformed ELF section " << i << ": " << image_file << std::endl;
+            return false;
+        }
+        load_bytes(store, addr, f.data + offset, size, big_endian);
+    }
+    return true;
+}
+
+static bool load_hex(const char *const image_file, MemoryStore &store)
+{
+    std::ifstream f(image_file);
     if (!f.is_open())
     {
-        std::cerr << "Failed to open file: " << hex_file << std::endl;
-        exit(-1);
+        std::cerr << "Failed to open file: " << image_file << std::endl;
+        return false;
     }
 
     uint addr = 0;
@@ -22,39 +228,126 @@ Memory::Memory(const char *const hex_file, double delay_factor) : delay_factor(d
     {
         if (memory_debug >= 3)
             std::cout << "Preload addr=" << addr << " data=" << data << std::endl;
-        m[addr++] = data;
+        store.write(addr++, data);
     }
     if (memory_debug >= 3)
         std::cout << std::noshowbase;
 
     f.close();
+    return true;
+}
+
+bool Memory::load_image(const char *const image_file, MemoryStore &store)
+{
+    size_t length = strlen(image_file);
+    bool is_bin = length >= 4 && strcmp(image_file + length - 4, ".bin") == 0;
+
+    MappedFile f;
+    if (!f.open(image_file))
+    {
+        if (!is_bin)
+            return load_hex(image_file, store); // reports the failure itself
+        std::cerr << "Failed to open file: " << image_file << std::endl;
+        return false;
+    }
+
+    if (f.size >= SELFMAG && memcmp(f.data, ELFMAG, SELFMAG) == 0)
+        return load_elf(image_file, f, store);
+
+    if (is_bin)
+    {
+        load_bytes(store, 0, f.data, f.size, true);
+        return true;
+    }
+
+    return load_hex(image_file, store);
 }
 
 void Memory::process(uint64_t time)
 {
     process_pipe();
+    process_deadlines(time);
     process_read(time);
     process_write(time);
 }
 
+// Order deadlines so that the earliest one sits at the top of the heap
+static bool later_deadline(const AxiDeadline &a, const AxiDeadline &b)
+{
+    return a.time > b.time;
+}
+
+void Memory::push_deadline(const AxiDeadline &deadline)
+{
+    deadlines[deadline_count++] = deadline;
+    std::push_heap(deadlines, deadlines + deadline_count, later_deadline);
+}
+
+// Called whenever a packet becomes the front of its per-ID queue
+void Memory::arm_read(int id)
+{
+    // Delay by 100 cycles
+    push_deadline(AxiDeadline{read_address[id].front().time_start + 1000 * delay_factor, uint8_t(id), false});
+}
+void Memory::arm_write(int id)
+{
+    // Delay by 120 cycles
+    push_deadline(AxiDeadline{write_address[id].front().time_start + 1200 * delay_factor, uint8_t(id), true});
+}
+
+// The armed deadlines were computed with the old factor; arm every front
+// packet again that has neither been committed nor come due
+void Memory::set_delay_factor(double factor)
+{
+    delay_factor = factor;
+    deadline_count = 0;
+    for (int id = 0; id < AXI_ID_COUNT; id++)
+    {
+        if (!read_address[id].empty() && !read_address[id].front().committed && !(read_due >> id & 1))
+            arm_read(id);
+        if (!write_address[id].empty() && !write_address[id].front().committed && !(write_due >> id & 1))
+            arm_write(id);
+    }
+}
+
+void Memory::process_deadlines(uint64_t time)
+{
+    while (deadline_count > 0 && !(deadlines[0].time > time))
+    {
+        auto &deadline = deadlines[0];
+        if (deadline.write)
+            write_due |= 1u << deadline.id;
+        else
+            read_due |= 1u << deadline.id;
+        std::pop_heap(deadlines, deadlines + deadline_count, later_deadline);
+        deadline_count--;
+    }
+}
+
 void Memory::process_pipe()
 {
     if (write_address_pipe != NULL && full_write_address() == PUSH_OK)
     {
-        write_address[write_address_pipe->awid].push(*write_address_pipe);
-        delete write_address_pipe;
+        auto &queue = write_address[write_address_pipe->awid];
+        queue.push(*write_address_pipe);
+        write_address_pending++;
+        if (queue.size() == 1)
+            arm_write(write_address_pipe->awid);
         write_address_pipe = NULL;
     }
     if (write_data_pipe != NULL && full_write_data() == PUSH_OK)
     {
         write_data[write_data_pipe->wid].push(*write_data_pipe);
-        delete write_data_pipe;
+        write_data_pending++;
         write_data_pipe = NULL;
     }
     if (read_address_pipe != NULL && full_read_address() == PUSH_OK)
     {
-        read_address[read_address_pipe->arid].push(*read_address_pipe);
-        delete read_address_pipe;
+        auto &queue = read_address[read_address_pipe->arid];
+        queue.push(*read_address_pipe);
+        read_address_pending++;
+        if (queue.size() == 1)
+            arm_read(read_address_pipe->arid);
         read_address_pipe = NULL;
     }
 }
@@ -67,17 +360,15 @@ bool Memory::full_write_address() const
     if (write_address[write_address_pipe->awid].size() >= AXI_WRITE_ADDR_MAX_PENDING_PER_ID)
         return PUSH_FULL;
 
-    int size = 0;
-    for (int i = 0; i < AXI_ID_COUNT; i++)
-        size += write_address[i].size();
-    if (size >= AXI_WRITE_ADDR_MAX_PENDING)
+    if (write_address_pending >= write_address_limit)
         return PUSH_FULL;
 
     return PUSH_OK;
 }
 void Memory::push_write_address(const AxiWriteAddress &pkt)
 {
-    write_address_pipe = new AxiWriteAddress(pkt);
+    write_address_slot = pkt;
+    write_address_pipe = &write_address_slot;
 }
 
 bool Memory::full_write_data() const
@@ -88,17 +379,15 @@ bool Memory::full_write_data() const
     if (write_data[write_data_pipe->wid].size() >= AXI_WRITE_DATA_MAX_PENDING_PER_ID)
         return PUSH_FULL;
 
-    int size = 0;
-    for (int i = 0; i < AXI_ID_COUNT; i++)
-        size += write_data[i].size();
-    if (size >= AXI_WRITE_DATA_MAX_PENDING)
+    if (write_data_pending >= write_address_limit * AXI_WRITE_DATA_MAX_BEATS)
         return PUSH_FULL;
 
     return PUSH_OK;
 }
 void Memory::push_write_data(const AxiWriteData &pkt)
 {
-    write_data_pipe = new AxiWriteData(pkt);
+    write_data_slot = pkt;
+    write_data_pipe = &write_data_slot;
 }
 
 bool Memory::full_read_address() const
@@ -109,17 +398,15 @@ bool Memory::full_read_address() const
     if (read_address[read_address_pipe->arid].size() >= AXI_READ_ADDR_MAX_PENDING_PER_ID)
         return PUSH_FULL;
 
-    int size = 0;
-    for (int i = 0; i < AXI_ID_COUNT; i++)
-        size += read_address[i].size();
-    if (size >= AXI_READ_ADDR_MAX_PENDING)
+    if (read_address_pending >= read_address_limit)
         return PUSH_FULL;
 
     return PUSH_OK;
 }
 void Memory::push_read_address(const AxiReadAddress &pkt)
 {
-    read_address_pipe = new AxiReadAddress(pkt);
+    read_address_slot = pkt;
+    read_address_pipe = &read_address_slot;
 }
 
 const AxiWriteResponse *const Memory::peek_write_response() const
@@ -137,58 +424,49 @@ const AxiReadData *const Memory::peek_read_data() const
 
 void Memory::pop_write_response()
 {
-    auto pkt = write_response.front();
+    auto &pkt = write_response.front();
     write_address[pkt.bid].pop();
+    write_address_pending--;
+    if (!write_address[pkt.bid].empty())
+        arm_write(pkt.bid);
     write_response.pop();
 }
 void Memory::pop_read_data()
 {
-    auto pkt = read_data.front();
+    auto &pkt = read_data.front();
     if (pkt.rlast)
+    {
         read_address[pkt.rid].pop();
+        read_address_pending--;
+        if (!read_address[pkt.rid].empty())
+            arm_read(pkt.rid);
+    }
     read_data.pop();
 }
 
 void Memory::process_read(uint64_t time)
 {
-    for (int i = 0; i < AXI_ID_COUNT; i++)
+    // Commit in ascending ID order, as a full scan would
+    for (uint32_t due = read_due; due != 0; due &= due - 1)
     {
-        if (read_address[i].empty())
-            continue;
-        auto &pkt = read_address[i].front();
-
-        // Skip if already committed
-        if (pkt.committed)
-            continue;
-
-        // Delay by 100 cycles
-        if (pkt.time_start + 1000 * delay_factor > time)
-            continue;
-
-        commit_read(pkt, time);
+        int i = __builtin_ctz(due);
+        commit_read(read_address[i].front(), time);
     }
+    read_due = 0;
 }
 void Memory::process_write(uint64_t time)
 {
-    for (int i = 0; i < AXI_ID_COUNT; i++)
+    for (uint32_t due = write_due; due != 0; due &= due - 1)
     {
-        if (write_address[i].empty())
-            continue;
+        int i = __builtin_ctz(due);
         auto &pkt = write_address[i].front();
 
-        // Skip if already committed
-        if (pkt.committed)
-            continue;
-
         // Skip if not all data are received
         if (write_data[i].size() < pkt.awlen)
             continue;
 
-        // Delay by 120 cycles
-        if (pkt.time_start + 1200 * delay_factor > time)
-            continue;
-
         commit_write(pkt, time);
+        write_due &= ~(1u << i);
     }
 }
 
@@ -199,7 +477,7 @@ void Memory::commit_read(AxiReadAddress &pkt, uint64_t time)
                   << std::hex << std::showbase;
     for (int i = 0; i < pkt.arlen; i++)
     {
-        auto data = m[(pkt.araddr >> 2) + i];
+        auto data = m.read((pkt.araddr >> 2) + i);
         read_data.push(AxiReadData{pkt.arid, i == pkt.arlen - 1, data});
         if (memory_debug)
             std::cout << data << " ";
@@ -218,10 +496,11 @@ void Memory::commit_write(AxiWriteAddress &pkt, uint64_t time)
     for (int i = 0; i < pkt.awlen; i++)
     {
         auto &data = write_data[pkt.awid].front();
-        m[(pkt.awaddr >> 2) + i] = data.wdata;
+        m.write((pkt.awaddr >> 2) + i, data.wdata);
         if (memory_debug)
             std::cout << data.wdata << " ";
         write_data[pkt.awid].pop();
+        write_data_pending--;
     }
     if (memory_debug)
         std::cout << "]\n"
@@ -3,7 +3,10 @@
 
 #include <iostream>
 #include <cstdint>
-#include <queue>
+#include <algorithm>
+
+#include "ring_buffer.h"
+#include "paged_store.h"
 
 #define ADDR_WIDTH 26
 #define DATA_WIDTH 32
@@ -23,6 +26,11 @@
 #define AXI_READ_DATA_MAX_PENDING (AXI_READ_ADDR_MAX_PENDING * AXI_READ_DATA_MAX_BEATS)
 #define AXI_READ_DATA_MAX_PENDING_PER_ID (AXI_READ_ADDR_MAX_PENDING_PER_ID * AXI_READ_DATA_MAX_BEATS)
 
+// AxLEN is 4 bits wide, so a committed burst never exceeds 16 beats
+#define AXI_MAX_BURST_LENGTH 16
+#define AXI_WRITE_RESPONSE_MAX_PENDING AXI_WRITE_ADDR_MAX_PENDING
+#define AXI_READ_RESPONSE_MAX_PENDING (AXI_READ_ADDR_MAX_PENDING * AXI_MAX_BURST_LENGTH)
+
 #define PUSH_OK 0
 #define PUSH_FULL 1
 
@@ -94,10 +102,26 @@ struct AxiReadData
     }
 };
 
+// A pending transaction at the front of its per-ID queue, keyed by the
+// time at which process() may commit it
+struct AxiDeadline
+{
+    double time;
+    uint8_t id;
+    bool write;
+};
+
+typedef PagedStore<ADDR_WIDTH - 2> MemoryStore;
+
 class Memory
 {
 public:
-    Memory(const char *const hex_file, double delay_factor = 1.0);
+    Memory(const char *const image_file, double delay_factor = 1.0);
+
+    // Preload a program image: an ELF executable (sections placed at their
+    // link addresses), a raw big-endian binary loaded at address 0 (*.bin),
+    // or a text file of hex words loaded at address 0 (anything else)
+    static bool load_image(const char *const image_file, MemoryStore &store);
 
     void process(uint64_t time);
 
@@ -113,24 +137,76 @@ public:
     void pop_write_response();
     void pop_read_data();
 
-    // Ingress pipe stage
+    void report_footprint(std::ostream &os, bool ranges = false) const { m.report_footprint(os, ranges); }
+
+    // Backing store, e.g. to replace the image with a fast-forwarded one
+    // before the core issues its first request
+    MemoryStore &store() { return m; }
+
+    // Runtime configuration, e.g. for sweeps from a warmed state. Limits
+    // on outstanding transactions are capped at the compile-time maxima
+    // the queues are sized for; a changed delay also applies to requests
+    // already waiting out theirs.
+    void set_delay_factor(double factor);
+    void set_pending_limits(unsigned read_address, unsigned write_address)
+    {
+        read_address_limit = std::min<unsigned>(read_address, AXI_READ_ADDR_MAX_PENDING);
+        write_address_limit = std::min<unsigned>(write_address, AXI_WRITE_ADDR_MAX_PENDING);
+    }
+
+    // Earliest time at which process() has work to do, or UINT64_MAX when
+    // only the core can make progress. Until then the memory is idle: no
+    // transaction is presented to the core and process() changes nothing.
+    uint64_t next_event_time() const;
+
+    // Start over with another program image: every in-flight transaction
+    // is dropped, the configuration above is kept
+    bool reload(const char *const image_file);
+
+    // Checkpoint of the backing store and every in-flight transaction
+    void save(std::ostream &os) const;
+    bool restore(std::istream &is);
+
+    // Ingress pipe stage (points at the matching *_slot, or NULL when empty)
     AxiWriteAddress *write_address_pipe;
     AxiWriteData *write_data_pipe;
     AxiReadAddress *read_address_pipe;
+    AxiWriteAddress write_address_slot;
+    AxiWriteData write_data_slot;
+    AxiReadAddress read_address_slot;
 
     // Ingress queues
-    std::queue<AxiWriteAddress> write_address[AXI_ID_COUNT];
-    std::queue<AxiWriteData> write_data[AXI_ID_COUNT];
-    std::queue<AxiReadAddress> read_address[AXI_ID_COUNT];
+    RingBuffer<AxiWriteAddress, AXI_WRITE_ADDR_MAX_PENDING_PER_ID> write_address[AXI_ID_COUNT];
+    RingBuffer<AxiWriteData, AXI_WRITE_DATA_MAX_PENDING_PER_ID> write_data[AXI_ID_COUNT];
+    RingBuffer<AxiReadAddress, AXI_READ_ADDR_MAX_PENDING_PER_ID> read_address[AXI_ID_COUNT];
+
+    // Ingress occupancy across all IDs
+    unsigned write_address_pending;
+    unsigned write_data_pending;
+    unsigned read_address_pending;
 
     // Egress queues
-    std::queue<AxiWriteResponse> write_response;
-    std::queue<AxiReadData> read_data;
+    RingBuffer<AxiWriteResponse, AXI_WRITE_RESPONSE_MAX_PENDING> write_response;
+    RingBuffer<AxiReadData, AXI_READ_RESPONSE_MAX_PENDING> read_data;
 
 private:
-    uint32_t m[1 << (ADDR_WIDTH - 2)];
+    MemoryStore m;
     double delay_factor;
+    unsigned read_address_limit;
+    unsigned write_address_limit;
+
+    // Min-heap of armed deadlines (at most one read and one write per ID)
+    AxiDeadline deadlines[2 * AXI_ID_COUNT];
+    unsigned deadline_count;
+
+    // IDs whose front packet has waited out its delay but is not committed
+    uint32_t read_due;
+    uint32_t write_due;
 
+    void arm_read(int id);
+    void arm_write(int id);
+    void push_deadline(const AxiDeadline &deadline);
+    void process_deadlines(uint64_t time);
     void process_pipe();
     void process_read(uint64_t time);
     void process_write(uint64_t time);
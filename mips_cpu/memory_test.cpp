@@ -0,0 +1,70 @@
+// Checks of the AXI memory model that the core cannot reach on its own.
+//
+//   memory_test [image]
+//
+// A sweep (-W/-X) forks from a warmed state and each child sets its own
+// delay factor. A read already queued at the fork must take the child's
+// latency, not the one it was armed with.
+#include <iostream>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "memory.h"
+
+int memory_debug = 0;
+
+#define READ_DELAY 1000 // time units per unit of delay factor, see Memory::arm_read
+
+// Processes the memory from `from` until read data shows up; its time, or 0
+static uint64_t first_read_data(Memory &mem, uint64_t from)
+{
+    for (uint64_t time = from; time < from + 100 * READ_DELAY; time += 10)
+    {
+        mem.process(time);
+        if (mem.peek_read_data())
+            return time;
+    }
+    return 0;
+}
+
+static bool expect(const char *what, uint64_t actual, uint64_t expected)
+{
+    if (actual == expected)
+        return true;
+    std::cerr << what << ": " << actual << ", expected " << expected << std::endl;
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    Memory mem(argc > 1 ? argv[1] : "../hexfiles/nqueens.hex", 1.0);
+
+    // Queued and armed with the parent's factor
+    mem.push_read_address(AxiReadAddress{3, 1, 0x100, 0, false});
+    mem.process(0);
+
+    pid_t const child = fork();
+    if (child < 0)
+    {
+        perror("fork");
+        return -1;
+    }
+    if (child == 0)
+    {
+        mem.set_delay_factor(3.0);
+        _exit(expect("child read latency", first_read_data(mem, 10), 3 * READ_DELAY) ? 0 : 1);
+    }
+
+    int status = 0;
+    waitpid(child, &status, 0);
+    bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    ok &= expect("parent read latency", first_read_data(mem, 10), READ_DELAY);
+
+    // A committed read is not armed again
+    mem.set_delay_factor(0.5);
+    mem.pop_read_data();
+    ok &= expect("data after the last beat", first_read_data(mem, READ_DELAY + 10), 0);
+
+    std::cout << (ok ? "memory_test passed" : "memory_test FAILED") << std::endl;
+    return ok ? 0 : -1;
+}
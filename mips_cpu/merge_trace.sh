@@ -1,31 +1,16 @@
 #!/bin/bash
 
 # Output file
-output_file="merged_trace.json"
+output_file="merged_trace.pftrace"
 
-# Start the JSON structure
-echo '{"otherData":{},"traceEvents": [' > "$output_file"
+# A Perfetto trace is a sequence of packets, and every trace written by the
+# simulator uses its own sequence id and track uuids, so concatenating the
+# files (rotated parts included) gives one valid trace
+: > "$output_file"
 
-# Initialize a variable to track if this is the first fragment
-first_fragment=true
-
-# Collect JSON fragments and append them to the output file
-for fragment_file in "$@"; do
-    echo "Adding $fragment_file"
-    
-    # If it's not the first fragment, add a comma before appending
-    if [ "$first_fragment" = false ]; then
-        echo -n "," >> "$output_file"
-    fi
-    
-    # Append the fragment
-    cat "$fragment_file" >> "$output_file"
-    
-    # Set first_fragment to false after the first iteration
-    first_fragment=false
+for trace_file in "$@"; do
+    echo "Adding $trace_file"
+    cat "$trace_file" >> "$output_file"
 done
 
-# Close the JSON structure
-echo "]}" >> "$output_file"
-
-echo "JSON fragments merged into $output_file"
\ No newline at end of file
+echo "Traces merged into $output_file"
@@ -14,6 +14,7 @@
  * See wiki page "Synchronous Caches" for details.
  */
 //`include "mips_core.svh"
+`include "simulation.svh"
 
 module fetch_unit (
 	// General signals
@@ -96,7 +97,11 @@ module fetch_unit (
 	always_ff @(posedge clk)
 	begin
 		if(~rst_n)
+		`ifdef SIMULATION
+			o_pc_current <= Address'(initial_pc());	// 0x0 unless fast-forwarded
+		`else
 			o_pc_current <= '0;	// Start point of programs are always 0x0
+		`endif
 		else
 		begin
 			o_pc_current <= o_pc_next;
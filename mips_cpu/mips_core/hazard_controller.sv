@@ -15,9 +15,7 @@
  * See wiki page "Branch and Jump" for details of branch and jump instructions.
  */
 
-`ifdef SIMULATION
-import "DPI-C" function void stats_event (input string e);
-`endif
+`include "simulation.svh"
 
 /*
 	Every possible hazard:
@@ -197,23 +195,33 @@ module hazard_controller (
 
 
 `ifdef SIMULATION
+	// Counter handles, registered once at start-up
+	int ic_miss_stat, br_miss_stat, dec_taken_stat, cq_overflow_stat;
+	int if_stall_stat, dec_stall_stat, dec_flush_stat, ren_stall_stat;
+
+	initial
+	begin
+		ic_miss_stat     = stats_register("ic_miss");
+		br_miss_stat     = stats_register("br_miss");
+		dec_taken_stat   = stats_register("dec_taken");
+		cq_overflow_stat = stats_register("cq_overflow");
+		if_stall_stat    = stats_register("if_stall");
+		dec_stall_stat   = stats_register("dec_stall");
+		dec_flush_stat   = stats_register("dec_flush");
+		ren_stall_stat   = stats_register("ren_stall");
+	end
+
 	always_ff @(posedge clk)
 	begin
-		if (ic_miss)      stats_event("ic_miss");
-	//	if (ds_miss)      stats_event("ds_miss");
-	//	if (dec_overload) stats_event("dec_overload");
-	//	if (ex_overload)  stats_event("ex_overload");
-	//	if (lw_hazard)    stats_event("lw_hazard");
-	//	if (dc_miss)      stats_event("dc_miss");
-	//	if (if_stall)     stats_event("if_stall");
-	//	if (if_flush)     stats_event("if_flush");
-	//	if (dec_stall)    stats_event("dec_stall");
-	//	if (dec_flush)    stats_event("dec_flush");
-	//	if (ex_stall)     stats_event("ex_stall");
-	//	if (ex_flush)     stats_event("ex_flush");
-	//	if (mem_stall)    stats_event("mem_stall");
-	//	if (mem_flush)    stats_event("mem_flush");
-		if (commit_misprediction) stats_event("br_miss");
+		if (ic_miss)              stats_increment(ic_miss_stat);
+		if (commit_misprediction) stats_increment(br_miss_stat);
+		if (D_prediction_valid && (D_prediction == TAKEN))
+		                          stats_increment(dec_taken_stat);
+		if (C_queue_overflow)     stats_increment(cq_overflow_stat);
+		if (fetch_hc.stall)       stats_increment(if_stall_stat);
+		if (decode_hc.stall)      stats_increment(dec_stall_stat);
+		if (decode_hc.flush)      stats_increment(dec_flush_stat);
+		if (rename_hc.stall)      stats_increment(ren_stall_stat);
 	end
 `endif
 
@@ -609,6 +609,17 @@ module mips_core (
 	// xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx
 `ifdef SIMULATION
 	/* verilator lint_off WIDTHEXPAND */
+	// An issue queue presents its instruction until the unit is done with it
+	logic       dispatch_presented       [EXECUTION_UNIT_COUNT];
+	CommitIndex dispatch_presented_index [EXECUTION_UNIT_COUNT];
+
+	// The access of each load/store by commit index, reported (ls_event)
+	// in program order as it commits
+	logic         ls_executed [COMMIT_QUEUE_SIZE];
+	MemAccessType ls_op       [COMMIT_QUEUE_SIZE];
+	Address       ls_addr     [COMMIT_QUEUE_SIZE];
+	Data          ls_data     [COMMIT_QUEUE_SIZE];
+
 	always_ff @(posedge clk)
 	begin
 		/*if (debug_level() >= 1 && dec_branch_decoded.valid)
@@ -673,6 +684,31 @@ module mips_core (
 				{R_output_instruction.src1, R_output_instruction.meta.uses_src1},
 				{R_output_instruction.src2, R_output_instruction.meta.uses_src2}
 			);
+			ls_executed[R_output_instruction.meta.commit_index] <= 1'b0;
+		end
+
+		if (execution_done[LOAD_STORE_UNIT])
+		begin
+			ls_executed[dispatched_instruction[1].meta.commit_index] <= 1'b1;
+			ls_op      [dispatched_instruction[1].meta.commit_index] <= dispatched_memory_command.access;
+			ls_addr    [dispatched_instruction[1].meta.commit_index] <= dispatched_memory_command.access == READ
+				? load_request.addr : memory_write.addr;
+			ls_data    [dispatched_instruction[1].meta.commit_index] <= dispatched_memory_command.access == READ
+				? dispatch_result[1].data : memory_write.data;
+		end
+
+		for (int u = 0; u < EXECUTION_UNIT_COUNT; ++u)
+		begin
+			if (dispatch_want_to_execute[u] && !(dispatch_presented[u]
+				&& dispatch_presented_index[u] == dispatched_instruction[u].meta.commit_index))
+			begin
+				`dispatch_event(
+					dispatched_instruction[u].meta.pc,
+					dispatched_instruction[u].meta.commit_index
+				)
+			end
+			dispatch_presented[u]       <= dispatch_want_to_execute[u] && !issue_hc.flush;
+			dispatch_presented_index[u] <= dispatched_instruction[u].meta.commit_index;
 		end
 
 		if (dispatch_want_commit)
@@ -710,6 +746,16 @@ module mips_core (
 			)
 		end
 
+		// Before commit_event and flush_event, which follow a commit
+		if (rst_n)
+		begin
+			commit_head_event(
+				o_commit_pc,
+				COMMIT_QUEUE.want_to_commit ? 2
+				: (!COMMIT_QUEUE.full && COMMIT_QUEUE.insert_index == COMMIT_QUEUE.commit_index) ? 0 : 1
+			);
+		end
+
 		if (COMMIT_QUEUE.want_to_commit)
 		begin
 			if (debug_level() >= 1)
@@ -724,11 +770,23 @@ module mips_core (
 				C_free_reg.index,
 			);
 			
+			if (ls_executed[COMMIT_QUEUE.commit_index])
+				ls_event(ls_op[COMMIT_QUEUE.commit_index], ls_addr[COMMIT_QUEUE.commit_index], ls_data[COMMIT_QUEUE.commit_index]);
 			`commit_event(
 				COMMIT_QUEUE.entries[COMMIT_QUEUE.commit_index].pc,
 				COMMIT_QUEUE.commit_index,
 				{C_write_back.index, C_write_back.valid},
-				{C_free_reg.index,   C_free_reg.valid}
+				{C_free_reg.index,   C_free_reg.valid},
+				C_write_back.data,
+				C_dst_mips
+			)
+		end
+
+		if (HAZARD_CONTROLLER.commit_misprediction)
+		begin
+			`flush_event(
+				COMMIT_QUEUE.entries[COMMIT_QUEUE.commit_index].pc,
+				COMMIT_QUEUE.commit_index
 			)
 		end
 
@@ -752,5 +810,129 @@ module mips_core (
 			pc_event(COMMIT_QUEUE.entries[COMMIT_QUEUE.commit_index].pc);
 		end
 	end
+
+	// Equal indices mean every register is free (it is never empty)
+	int free_registers;
+	assign free_registers = FREE_LIST.insert_index == FREE_LIST.allocate_index ? FREE_REG_COUNT
+		: (FREE_LIST.insert_index - FREE_LIST.allocate_index) & (FREE_REG_COUNT - 1);
+
+	// Rename waits for a register; the last one is never handed out (see
+	// register_free_list)
+	logic free_list_stalled;
+	assign free_list_stalled = R_want_dst_reg && free_registers <= 1;
+
+	// The load at the head of the commit queue waits on the d-cache
+	logic head_load_waiting;
+	assign head_load_waiting = load_request.valid && !execution_done[LOAD_STORE_UNIT]
+		&& dispatched_instruction[1].meta.commit_index == COMMIT_QUEUE.commit_index;
+
+	// Occupancy of each queue, and the registers left in the free list,
+	// with the cycles each being full (the free list: empty) stalls a stage
+	int commit_queue_gauge, store_queue_gauge, general_queue_gauge;
+	int load_store_queue_gauge, free_list_gauge;
+	int commit_queue_stall, store_queue_stall, general_queue_stall;
+	int load_store_queue_stall, free_list_stall;
+
+	initial
+	begin
+		commit_queue_gauge     = stats_register_gauge("commit_queue",                 COMMIT_QUEUE_SIZE);
+		store_queue_gauge      = stats_register_gauge("store_queue",                  STORE_QUEUE_SIZE);
+		general_queue_gauge    = stats_register_gauge("general_instruction_queue",    COMMIT_QUEUE_SIZE);
+		load_store_queue_gauge = stats_register_gauge("load_store_instruction_queue", COMMIT_QUEUE_SIZE);
+		free_list_gauge        = stats_register_gauge("register_free_list",           FREE_REG_COUNT);
+
+		commit_queue_stall     = stats_register("commit_queue_stall");
+		store_queue_stall      = stats_register("store_queue_stall");
+		general_queue_stall    = stats_register("general_instruction_queue_stall");
+		load_store_queue_stall = stats_register("load_store_instruction_queue_stall");
+		free_list_stall        = stats_register("register_free_list_stall");
+	end
+
+	always_ff @(posedge clk)
+	begin
+		int general, load_store;
+		general    = 0;
+		load_store = 0;
+		for (int i = 0; i < COMMIT_QUEUE_SIZE; ++i)
+		begin
+			general    += GENERAL_QUEUE.occupied[i];
+			load_store += LOAD_STORE_QUEUE.occupied[i];
+		end
+
+		stats_gauge(commit_queue_gauge, COMMIT_QUEUE.full ? COMMIT_QUEUE_SIZE
+			: (COMMIT_QUEUE.insert_index - COMMIT_QUEUE.commit_index) & (COMMIT_QUEUE_SIZE - 1));
+		stats_gauge(store_queue_gauge, STORE_QUEUE.full ? STORE_QUEUE_SIZE
+			: (STORE_QUEUE.insert_index - STORE_QUEUE.remove_index) & (STORE_QUEUE_SIZE - 1));
+		stats_gauge(general_queue_gauge, general);
+		stats_gauge(load_store_queue_gauge, load_store);
+		stats_gauge(free_list_gauge, free_registers);
+
+		// Rename stalls on the commit queue; the instruction queues are as
+		// large, so they fill only along with it
+		if (C_queue_overflow)
+		begin
+			stats_increment(commit_queue_stall);
+			if (general    == COMMIT_QUEUE_SIZE) stats_increment(general_queue_stall);
+			if (load_store == COMMIT_QUEUE_SIZE) stats_increment(load_store_queue_stall);
+		end
+		// A store holds up the load/store unit until it gets in
+		if (memory_write.valid && !wrote_store_queue)
+			stats_increment(store_queue_stall);
+		if (free_list_stalled)
+			stats_increment(free_list_stall);
+	end
+
+	// CPI stack: each cycle counts toward the first of these that holds
+	int cpi_base_stat, cpi_icache_stat, cpi_branch_stat, cpi_dcache_stat;
+	int cpi_sq_full_stat, cpi_cq_full_stat, cpi_fl_empty_stat, cpi_iq_starve_stat;
+	int cpi_exec_stat, cpi_reset_stat;
+	int cpi_frontend_stat; // what last emptied the commit queue
+
+	initial
+	begin
+		cpi_base_stat      = stats_register("cpi_base");
+		cpi_icache_stat    = stats_register("cpi_icache");
+		cpi_branch_stat    = stats_register("cpi_branch");
+		cpi_dcache_stat    = stats_register("cpi_dcache");
+		cpi_sq_full_stat   = stats_register("cpi_sq_full");
+		cpi_cq_full_stat   = stats_register("cpi_cq_full");
+		cpi_fl_empty_stat  = stats_register("cpi_fl_empty");
+		cpi_iq_starve_stat = stats_register("cpi_iq_starve");
+		cpi_exec_stat      = stats_register("cpi_exec");
+		cpi_reset_stat     = stats_register("cpi_reset");
+	end
+
+	always_ff @(posedge clk)
+	begin
+		if (~rst_n)
+		begin
+			cpi_frontend_stat <= cpi_icache_stat;
+			stats_increment(cpi_reset_stat);
+		end
+		else
+		begin
+			if (HAZARD_CONTROLLER.commit_misprediction)
+				cpi_frontend_stat <= cpi_branch_stat;
+			else if (HAZARD_CONTROLLER.ic_miss)
+				cpi_frontend_stat <= cpi_icache_stat;
+
+			if (COMMIT_QUEUE.want_to_commit)
+				stats_increment(cpi_base_stat);
+			else if (!COMMIT_QUEUE.full && COMMIT_QUEUE.insert_index == COMMIT_QUEUE.commit_index)
+				stats_increment(HAZARD_CONTROLLER.ic_miss ? cpi_icache_stat : cpi_frontend_stat);
+			else if (head_load_waiting)
+				stats_increment(cpi_dcache_stat);
+			else if (memory_write.valid && !wrote_store_queue)
+				stats_increment(cpi_sq_full_stat);
+			else if (C_queue_overflow)
+				stats_increment(cpi_cq_full_stat);
+			else if (free_list_stalled)
+				stats_increment(cpi_fl_empty_stat);
+			else if (!dispatch_want_commit)
+				stats_increment(cpi_iq_starve_stat);
+			else
+				stats_increment(cpi_exec_stat);
+		end
+	end
 `endif
 endmodule
\ No newline at end of file
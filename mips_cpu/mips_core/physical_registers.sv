@@ -1,3 +1,5 @@
+`include "simulation.svh"
+
 
 module physical_registers #(
     parameter WIDTH = 1
@@ -54,6 +56,12 @@ module physical_registers #(
             valid <= '1;
             for (int i = 0; i < PHYS_REG_COUNT; ++i)
                 data[i] <= '0;
+        `ifdef SIMULATION
+            // MIPS register i starts out mapped to p{i}, so a
+            //  fast-forwarded register file is loaded in place
+            for (int i = 0; i < MIPS_REG_COUNT; ++i)
+                data[i] <= Data'(initial_register(i));
+        `endif
         end
         else if (i_flush)
         begin
@@ -0,0 +1,129 @@
+#ifndef __INC__PAGED_STORE_H__
+#define __INC__PAGED_STORE_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+#include "checkpoint.h"
+
+// Word-addressed backing store that allocates 4 KB pages on first write.
+// Reads from a page that was never written return zero without allocating.
+template <unsigned WORD_ADDR_WIDTH>
+class PagedStore
+{
+public:
+    static constexpr unsigned PAGE_BITS = 10; // 1024 words = 4 KB
+    static constexpr uint32_t PAGE_WORDS = 1u << PAGE_BITS;
+    static constexpr uint32_t WORD_COUNT = 1u << WORD_ADDR_WIDTH;
+    static constexpr uint32_t PAGE_COUNT = WORD_COUNT >> PAGE_BITS;
+
+    uint32_t read(uint32_t word) const
+    {
+        word &= WORD_COUNT - 1;
+        const uint32_t *page = pages[word >> PAGE_BITS].get();
+        return page ? page[word & (PAGE_WORDS - 1)] : 0;
+    }
+
+    void write(uint32_t word, uint32_t data)
+    {
+        word &= WORD_COUNT - 1;
+        auto &page = pages[word >> PAGE_BITS];
+        if (!page)
+        {
+            page.reset(new uint32_t[PAGE_WORDS]());
+            touched++;
+        }
+        page[word & (PAGE_WORDS - 1)] = data;
+    }
+
+    // Release every page
+    void clear()
+    {
+        for (auto &page : pages)
+            page.reset();
+        touched = 0;
+    }
+
+    // Replace the contents with a copy of other's allocated pages
+    void assign(const PagedStore &other)
+    {
+        touched = 0;
+        for (uint32_t i = 0; i < PAGE_COUNT; i++)
+        {
+            if (!other.pages[i])
+            {
+                pages[i].reset();
+                continue;
+            }
+            if (!pages[i])
+                pages[i].reset(new uint32_t[PAGE_WORDS]);
+            memcpy(pages[i].get(), other.pages[i].get(), PAGE_WORDS * sizeof(uint32_t));
+            touched++;
+        }
+    }
+
+    // Allocated pages only, as (page index, words) pairs
+    void save(std::ostream &os) const
+    {
+        checkpoint_put(os, uint32_t(touched));
+        for (uint32_t i = 0; i < PAGE_COUNT; i++)
+        {
+            if (!pages[i])
+                continue;
+            checkpoint_put(os, i);
+            os.write(reinterpret_cast<const char *>(pages[i].get()), PAGE_WORDS * sizeof(uint32_t));
+        }
+    }
+
+    bool restore(std::istream &is)
+    {
+        clear();
+
+        uint32_t count, index;
+        if (!checkpoint_get(is, count))
+            return false;
+        for (; touched < count; touched++)
+        {
+            if (!checkpoint_get(is, index) || index >= PAGE_COUNT)
+                return false;
+            pages[index].reset(new uint32_t[PAGE_WORDS]);
+            if (!is.read(reinterpret_cast<char *>(pages[index].get()), PAGE_WORDS * sizeof(uint32_t)))
+                return false;
+        }
+        return true;
+    }
+
+    size_t touched_pages() const { return touched; }
+    size_t footprint_bytes() const { return touched * PAGE_WORDS * sizeof(uint32_t); }
+
+    // One line summary, plus the byte ranges of touched pages if requested
+    void report_footprint(std::ostream &os, bool ranges = false) const
+    {
+        os << "memory footprint: " << std::dec << touched << " pages ("
+           << footprint_bytes() / 1024 << " KB)" << std::endl;
+        if (!ranges)
+            return;
+        for (uint32_t i = 0; i < PAGE_COUNT; i++)
+        {
+            if (!pages[i])
+                continue;
+            uint32_t first = i;
+            while (i + 1 < PAGE_COUNT && pages[i + 1])
+                i++;
+            os << "  [" << std::hex << std::showbase << byte_address(first) << ", "
+               << byte_address(i + 1) << ")" << std::dec << std::noshowbase
+               << " " << (i + 1 - first) << " pages" << std::endl;
+        }
+    }
+
+private:
+    std::unique_ptr<uint32_t[]> pages[PAGE_COUNT];
+    size_t touched = 0;
+
+    static uint64_t byte_address(uint32_t page) { return uint64_t(page) << (PAGE_BITS + 2); }
+};
+
+#endif
@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include "pc_profile.h"
+#include "iss.h"
+
+static constexpr const char *reason_names[PROFILE_REASONS] = {
+    "commit",
+    "load",
+    "store",
+    "branch",
+    "execute",
+    "flush",
+    "frontend",
+};
+
+#define PROFILE_HOTTEST 20
+
+uint64_t PcProfile::Entry::total() const
+{
+    uint64_t sum = 0;
+    for (uint64_t c : cycles)
+        sum += c;
+    return sum;
+}
+
+void PcProfile::reset(const MemoryStore *program)
+{
+    this->program = program;
+    entries.clear();
+    std::fill(std::begin(totals), std::end(totals), 0);
+    frontend_pending = 0;
+    flushing = false;
+    last_state = -1;
+}
+
+PcProfile::Entry &PcProfile::entry(uint32_t pc)
+{
+    auto it = entries.find(pc);
+    if (it == entries.end())
+    {
+        Entry e;
+        e.ins = Iss::decode(program->read((pc & Iss::ADDR_MASK) >> 2), pc).ins;
+        it = entries.emplace(pc, e).first;
+    }
+    return it->second;
+}
+
+void PcProfile::charge(uint32_t pc, int state, uint64_t cycles)
+{
+    if (state == HEAD_EMPTY)
+    {
+        if (flushing)
+        {
+            entry(flush_pc).cycles[PROFILE_FLUSH] += cycles;
+            totals[PROFILE_FLUSH] += cycles;
+        }
+        else
+        {
+            frontend_pending += cycles;
+            totals[PROFILE_FRONTEND] += cycles;
+        }
+        return;
+    }
+
+    Entry &e = entry(pc);
+    ProfileReason reason = PROFILE_EXECUTE;
+    if (state == HEAD_COMMITTING)
+    {
+        reason = PROFILE_COMMIT;
+        e.cycles[PROFILE_FRONTEND] += frontend_pending;
+        frontend_pending = 0;
+        flushing = false;
+    }
+    else if (e.ins == INS_LW)
+        reason = PROFILE_LOAD;
+    else if (e.ins == INS_SW)
+        reason = PROFILE_STORE;
+    else if (e.ins >= INS_J && e.ins <= INS_BGTZ)
+        reason = PROFILE_BRANCH;
+    e.cycles[reason] += cycles;
+    totals[reason] += cycles;
+}
+
+void PcProfile::head(uint32_t pc, int state)
+{
+    charge(pc, state, 1);
+    last_pc = pc;
+    last_state = state;
+}
+
+void PcProfile::repeat(uint64_t cycles)
+{
+    if (last_state >= 0)
+        charge(last_pc, last_state, cycles);
+}
+
+// "  4c:\t8c820000 \tlw\tv0,0(a0)" -> 0x4c
+static bool parse_instruction_line(const std::string &line, uint32_t &pc)
+{
+    char *end = nullptr;
+    unsigned long const value = strtoul(line.c_str(), &end, 16);
+    if (end == line.c_str() || *end != ':' || end[1] != '\t' || !isspace(uint8_t(line[0])))
+        return false;
+    pc = uint32_t(value);
+    return true;
+}
+
+// "00000080 <main>:" -> main
+static bool parse_function_line(const std::string &line, std::string &name)
+{
+    size_t const open = line.find(" <");
+    if (line.empty() || !isxdigit(uint8_t(line[0])) || open == std::string::npos
+        || line.size() < open + 4 || line.compare(line.size() - 2, 2, ">:") != 0)
+        return false;
+    name = line.substr(open + 2, line.size() - open - 4);
+    return true;
+}
+
+static std::string percent(uint64_t part, uint64_t whole)
+{
+    std::ostringstream s;
+    s << std::fixed << std::setprecision(1) << (whole ? 100.0 * part / whole : 0.0) << "%";
+    return s.str();
+}
+
+static void breakdown_header(std::ostream &os, const char *first)
+{
+    os << std::setw(24) << std::left << first << std::right << std::setw(12) << "cycles" << std::setw(8) << "%";
+    for (const char *name : reason_names)
+        os << std::setw(10) << name;
+    os << "\n";
+}
+
+static void breakdown_row(std::ostream &os, const std::string &label, const uint64_t *cycles, uint64_t total)
+{
+    uint64_t sum = 0;
+    for (unsigned r = 0; r < PROFILE_REASONS; r++)
+        sum += cycles[r];
+    os << std::setw(24) << std::left << label << std::right << std::setw(12) << sum
+       << std::setw(8) << percent(sum, total);
+    for (unsigned r = 0; r < PROFILE_REASONS; r++)
+        os << std::setw(10) << cycles[r];
+    os << "\n";
+}
+
+bool PcProfile::write(const std::string &file_name, const std::string &dis_file) const
+{
+    std::ofstream os(file_name);
+    if (!os)
+    {
+        std::cerr << "Failed to open file: " << file_name << std::endl;
+        return false;
+    }
+
+    uint64_t total = 0;
+    for (uint64_t c : totals)
+        total += c;
+
+    os << "== Cycles by reason ====\n";
+    for (unsigned r = 0; r < PROFILE_REASONS; r++)
+        os << std::setw(10) << std::left << reason_names[r] << std::right
+           << std::setw(12) << totals[r] << std::setw(8) << percent(totals[r], total) << "\n";
+    if (frontend_pending)
+        os << "(" << frontend_pending << " frontend cycles after the last commit are not charged)\n";
+
+    // The disassembly gives the text of each pc and the function it is in
+    std::vector<std::string> listing;
+    std::map<uint32_t, std::string> text, function_of;
+    std::map<std::string, std::vector<uint64_t>> functions;
+    std::ifstream dis(dis_file);
+    std::string line, function = "?";
+    while (std::getline(dis, line))
+    {
+        uint32_t pc;
+        if (parse_function_line(line, function))
+            functions[function].assign(PROFILE_REASONS, 0);
+        else if (parse_instruction_line(line, pc))
+        {
+            size_t const colon = line.find(':');
+            text[pc] = line.substr(colon + 2);
+            function_of[pc] = function;
+        }
+        listing.push_back(line);
+    }
+
+    std::vector<std::pair<uint32_t, const Entry *>> hottest;
+    for (const auto &e : entries)
+    {
+        hottest.push_back({e.first, &e.second});
+        auto const f = function_of.find(e.first);
+        if (f == function_of.end())
+            continue;
+        std::vector<uint64_t> &sums = functions[f->second];
+        sums.resize(PROFILE_REASONS);
+        for (unsigned r = 0; r < PROFILE_REASONS; r++)
+            sums[r] += e.second.cycles[r];
+    }
+
+    if (!functions.empty())
+    {
+        std::vector<std::pair<uint64_t, std::string>> order;
+        for (const auto &f : functions)
+        {
+            uint64_t sum = 0;
+            for (uint64_t c : f.second)
+                sum += c;
+            if (sum)
+                order.push_back({sum, f.first});
+        }
+        std::sort(order.rbegin(), order.rend());
+        os << "\n== Functions ===========\n";
+        breakdown_header(os, "function");
+        for (const auto &f : order)
+            breakdown_row(os, f.second, functions[f.second].data(), total);
+    }
+
+    std::sort(hottest.begin(), hottest.end(), [](const auto &a, const auto &b) {
+        return a.second->total() > b.second->total();
+    });
+    if (hottest.size() > PROFILE_HOTTEST)
+        hottest.resize(PROFILE_HOTTEST);
+    os << "\n== Instructions ========\n";
+    breakdown_header(os, "pc");
+    for (const auto &h : hottest)
+    {
+        std::ostringstream label;
+        label << std::hex << std::setw(8) << std::setfill('0') << h.first;
+        breakdown_row(os, label.str(), h.second->cycles, total);
+        auto const t = text.find(h.first);
+        os << "    " << (t != text.end() ? t->second : to_string(h.second->ins)) << "\n";
+    }
+
+    if (listing.empty())
+    {
+        os << "\n(no disassembly in " << dis_file << ")\n";
+        return true;
+    }
+
+    // cycles, share of the run and the main reason, then the line
+    os << "\n== Listing =============\n";
+    for (const std::string &l : listing)
+    {
+        uint32_t pc;
+        auto const e = parse_instruction_line(l, pc) ? entries.find(pc) : entries.end();
+        if (e == entries.end() || e->second.total() == 0)
+        {
+            os << std::setw(37) << "" << "| " << l << "\n";
+            continue;
+        }
+        const Entry &entry = e->second;
+        unsigned const main = std::max_element(entry.cycles, entry.cycles + PROFILE_REASONS) - entry.cycles;
+        os << std::setw(10) << entry.total() << std::setw(8) << percent(entry.total(), total) << "  "
+           << std::setw(9) << std::left << reason_names[main] << std::right
+           << std::setw(7) << percent(entry.cycles[main], entry.total()) << " | " << l << "\n";
+    }
+    return true;
+}
@@ -0,0 +1,81 @@
+#ifndef __INC__PC_PROFILE_H__
+#define __INC__PC_PROFILE_H__
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+#include "memory.h"
+#include "simulation.h"
+
+/*
+ * Per-pc cycle attribution (-A), a perf annotate for the simulated core.
+ *
+ * Every cycle is charged to one instruction, with a reason:
+ *   commit   the instruction at the head of the commit queue commits
+ *   load     the head is a load that has not completed
+ *   store    the head is a store that has not issued
+ *   branch   the head is a branch or jump that has not resolved
+ *   execute  the head is any other instruction that has not executed
+ *   flush    the queue is empty after a misprediction; charged to the
+ *            mispredicted branch
+ *   frontend the queue is empty otherwise; charged to the next
+ *            instruction to commit
+ * The report joins the cycles against the disassembly, hexfiles/<BENCHMARK>.dis.
+ */
+
+enum ProfileReason
+{
+    PROFILE_COMMIT,
+    PROFILE_LOAD,
+    PROFILE_STORE,
+    PROFILE_BRANCH,
+    PROFILE_EXECUTE,
+    PROFILE_FLUSH,
+    PROFILE_FRONTEND,
+    PROFILE_REASONS
+};
+
+// commit_head_event states
+enum { HEAD_EMPTY = 0, HEAD_WAITING = 1, HEAD_COMMITTING = 2 };
+
+class PcProfile
+{
+public:
+    // program: to classify instructions by their encoding
+    void reset(const MemoryStore *program);
+
+    // One cycle of the commit head
+    void head(uint32_t pc, int state);
+    // The instruction committing this cycle flushes what follows it
+    void flush(uint32_t pc) { flush_pc = pc; flushing = true; }
+    // Cycles in which the head stays as in the last one (-q)
+    void repeat(uint64_t cycles);
+
+    // Summary, hottest functions and instructions, then the listing
+    bool write(const std::string &file_name, const std::string &dis_file) const;
+
+private:
+    struct Entry
+    {
+        Instruction ins;
+        uint64_t cycles[PROFILE_REASONS] = {};
+
+        uint64_t total() const;
+    };
+
+    const MemoryStore *program = nullptr;
+    std::unordered_map<uint32_t, Entry> entries;
+    uint64_t totals[PROFILE_REASONS] = {};
+    uint64_t frontend_pending = 0; // charged at the next commit
+    uint32_t flush_pc = 0;
+    bool flushing = false;         // since the flush, until the next commit
+    uint32_t last_pc = 0;
+    int last_state = -1;
+
+    Entry &entry(uint32_t pc);
+    void charge(uint32_t pc, int state, uint64_t cycles);
+};
+
+#endif
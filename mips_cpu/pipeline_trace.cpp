@@ -0,0 +1,370 @@
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <functional>
+
+#include "pipeline_trace.h"
+#include "simulation.h"
+
+static constexpr const char *stage_names[PIPELINE_STAGES] = {
+    "Fetch",
+    "Decode",
+    "Rename",
+    "Issue",
+    "Commit",
+};
+
+// Simulated time is shown at one cycle per microsecond
+#define TRACE_NS_PER_TIME 100
+#define TRACE_NS_PER_CYCLE 1000
+
+// =====================================================================
+// Protobuf encoding (only what the Perfetto schema below needs)
+// =====================================================================
+
+enum WireType { VARINT = 0, LENGTH_DELIMITED = 2 };
+
+static void put_varint(std::string &s, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        s += char(uint8_t(value) | 0x80);
+        value >>= 7;
+    }
+    s += char(value);
+}
+
+static void put_uint(std::string &s, unsigned field, uint64_t value)
+{
+    put_varint(s, field << 3 | VARINT);
+    put_varint(s, value);
+}
+
+static void put_bytes(std::string &s, unsigned field, const char *data, size_t size)
+{
+    put_varint(s, field << 3 | LENGTH_DELIMITED);
+    put_varint(s, size);
+    s.append(data, size);
+}
+
+static void put_bytes(std::string &s, unsigned field, const std::string &data)
+{
+    put_bytes(s, field, data.data(), data.size());
+}
+
+// Field numbers of perfetto/trace/trace_packet.proto and friends
+enum
+{
+    TRACE_PACKET = 1, // Trace.packet
+
+    PACKET_TIMESTAMP = 8,
+    PACKET_SEQUENCE_ID = 10, // trusted_packet_sequence_id
+    PACKET_TRACK_EVENT = 11,
+    PACKET_TRACK_DESCRIPTOR = 60,
+
+    TRACK_UUID = 1, // TrackDescriptor
+    TRACK_NAME = 2,
+    TRACK_PROCESS = 3,
+    TRACK_THREAD = 4,
+    TRACK_PARENT_UUID = 5,
+
+    PROCESS_PID = 1, // ProcessDescriptor
+    PROCESS_NAME = 6,
+
+    THREAD_PID = 1, // ThreadDescriptor
+    THREAD_TID = 2,
+    THREAD_NAME = 5,
+
+    EVENT_ANNOTATIONS = 4, // TrackEvent
+    EVENT_TYPE = 9,
+    EVENT_TRACK_UUID = 11,
+    EVENT_NAME = 23,
+
+    ANNOTATION_INT = 4, // DebugAnnotation
+    ANNOTATION_STRING = 6,
+    ANNOTATION_NAME = 10,
+};
+
+enum { SLICE_BEGIN = 1, SLICE_END = 2 };
+
+static void annotate(std::string &s, const char *name, int64_t value)
+{
+    std::string a;
+    put_bytes(a, ANNOTATION_NAME, name, strlen(name));
+    put_uint(a, ANNOTATION_INT, uint64_t(value));
+    put_bytes(s, EVENT_ANNOTATIONS, a);
+}
+
+static void annotate(std::string &s, const char *name, const char *value)
+{
+    std::string a;
+    put_bytes(a, ANNOTATION_NAME, name, strlen(name));
+    put_bytes(a, ANNOTATION_STRING, value, strlen(value));
+    put_bytes(s, EVENT_ANNOTATIONS, a);
+}
+
+static void annotate_hex(std::string &s, const char *name, uint32_t value)
+{
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%08x", value);
+    annotate(s, name, buffer);
+}
+
+// Physical registers carry a valid flag in their least significant bit
+static void annotate_reg(std::string &s, const char *name, int reg)
+{
+    if (!(reg & 1))
+        return;
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "p%d", reg >> 1);
+    annotate(s, name, buffer);
+}
+
+// =====================================================================
+// TraceFilter
+// =====================================================================
+
+// Comma separated pc:<LOW>-<HIGH> (hex), cycles:<FROM>[-<TO>],
+// stages:<any of FDRIC> and rotate:<MB>
+bool TraceFilter::parse(const char *spec)
+{
+    std::stringstream list(spec);
+    std::string item;
+    while (std::getline(list, item, ','))
+    {
+        size_t const colon = item.find(':');
+        if (colon == std::string::npos)
+            return false;
+        std::string const key = item.substr(0, colon), value = item.substr(colon + 1);
+        size_t const dash = value.find('-');
+        try
+        {
+            if (key == "pc")
+            {
+                pc_low = std::stoul(value.substr(0, dash), nullptr, 16);
+                pc_high = dash == std::string::npos ? pc_low : std::stoul(value.substr(dash + 1), nullptr, 16);
+            }
+            else if (key == "cycles")
+            {
+                from = std::stoull(value.substr(0, dash));
+                to = dash == std::string::npos ? 0 : std::stoull(value.substr(dash + 1));
+            }
+            else if (key == "stages")
+            {
+                stages = 0;
+                for (char c : value)
+                {
+                    const char *const letters = "FDRIC";
+                    const char *const p = strchr(letters, toupper(c));
+                    if (!p || !c)
+                        return false;
+                    stages |= 1u << (p - letters);
+                }
+            }
+            else if (key == "rotate")
+                rotate_bytes = std::stoull(value) << 20;
+            else
+                return false;
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+    }
+    return pc_low <= pc_high && (!to || to > from);
+}
+
+// =====================================================================
+// PipelineTracer
+// =====================================================================
+
+bool PipelineTracer::open(const std::string &base, const std::string &process_name, const TraceFilter &filter)
+{
+    close();
+    this->base = base;
+    this->process_name = process_name;
+    this->filter = filter;
+    recorded = 0;
+    file_index = 0;
+    // Distinct per trace, so that merged traces keep their tracks apart
+    sequence = std::hash<std::string>()(base + "/" + process_name) & 0x7fffff00;
+    if (sequence == 0)
+        sequence = 0x100;
+    if (!open_file())
+        return false;
+
+    stopping.store(false, std::memory_order_relaxed);
+    writer = std::thread(&PipelineTracer::run, this);
+    return true;
+}
+
+bool PipelineTracer::open_file()
+{
+    std::string const name = base + (file_index ? "." + std::to_string(file_index) : "") + ".pftrace";
+    f = fopen(name.c_str(), "wb");
+    if (f == NULL)
+    {
+        std::cerr << "Failed to open file: " << name << std::endl;
+        return false;
+    }
+    file_bytes = 0;
+    write_descriptors();
+    return true;
+}
+
+// Frame the packet being built and append it to the file
+void PipelineTracer::write_packet()
+{
+    scratch.clear();
+    put_bytes(scratch, TRACE_PACKET, packet);
+    fwrite(scratch.data(), 1, scratch.size(), f);
+    file_bytes += scratch.size();
+    packet.clear();
+}
+
+// One process track for the run, with a thread track per stage
+void PipelineTracer::write_descriptors()
+{
+    uint32_t const pid = uint32_t(sequence >> 8);
+
+    std::string process;
+    put_uint(process, PROCESS_PID, pid);
+    put_bytes(process, PROCESS_NAME, process_name);
+    std::string track;
+    put_uint(track, TRACK_UUID, sequence);
+    put_bytes(track, TRACK_PROCESS, process);
+    put_uint(packet, PACKET_SEQUENCE_ID, uint32_t(sequence));
+    put_bytes(packet, PACKET_TRACK_DESCRIPTOR, track);
+    write_packet();
+
+    for (unsigned stage = 0; stage < PIPELINE_STAGES; stage++)
+    {
+        std::string thread;
+        put_uint(thread, THREAD_PID, pid);
+        put_uint(thread, THREAD_TID, pid + stage + 1);
+        put_bytes(thread, THREAD_NAME, stage_names[stage], strlen(stage_names[stage]));
+        track.clear();
+        put_uint(track, TRACK_UUID, sequence + stage + 1);
+        put_uint(track, TRACK_PARENT_UUID, sequence);
+        put_bytes(track, TRACK_THREAD, thread);
+        put_uint(packet, PACKET_SEQUENCE_ID, uint32_t(sequence));
+        put_bytes(packet, PACKET_TRACK_DESCRIPTOR, track);
+        write_packet();
+    }
+}
+
+// A one cycle slice on the stage's track, with the fields as annotations
+void PipelineTracer::encode(const StageRecord &r)
+{
+    const int32_t *const v = r.fields;
+    char name[32];
+    annotations.clear();
+    annotate_hex(annotations, "pc", v[0]);
+    switch (r.stage)
+    {
+    case 0:
+        snprintf(name, sizeof(name), "F");
+        annotate_hex(annotations, "raw_instruction", v[1]);
+        break;
+    case 1:
+        snprintf(name, sizeof(name), "%s", to_string(Instruction(v[1])));
+        annotate(annotations, "rw", to_string(Register(v[2])));
+        annotate(annotations, "rs", to_string(Register(v[3])));
+        annotate(annotations, "rt", to_string(Register(v[4])));
+        annotate(annotations, "imm", v[5]);
+        break;
+    case 2:
+        if (v[3] & 1)
+            snprintf(name, sizeof(name), "p%d", v[3] >> 1);
+        else
+            snprintf(name, sizeof(name), "I");
+        annotate(annotations, "Commit Index", v[1]);
+        annotate_reg(annotations, "src1", v[4]);
+        annotate_reg(annotations, "src2", v[5]);
+        annotate(annotations, "old", v[2]);
+        break;
+    case 3:
+        snprintf(name, sizeof(name), "C%d", v[1]);
+        annotate(annotations, "Commit Index", v[1]);
+        annotate(annotations, "result", v[2]);
+        annotate(annotations, "outcome", v[3]);
+        break;
+    default:
+        snprintf(name, sizeof(name), "C%d", v[1]);
+        annotate_reg(annotations, "dst", v[2]);
+        annotate_reg(annotations, "free", v[3]);
+        annotate(annotations, "Commit Index", v[1]);
+        break;
+    }
+
+    uint64_t const track = sequence + r.stage + 1;
+    uint64_t const ts = r.time * TRACE_NS_PER_TIME;
+
+    scratch.clear();
+    put_uint(scratch, EVENT_TYPE, SLICE_BEGIN);
+    put_uint(scratch, EVENT_TRACK_UUID, track);
+    put_bytes(scratch, EVENT_NAME, name, strlen(name));
+    scratch += annotations;
+    put_uint(packet, PACKET_TIMESTAMP, ts);
+    put_uint(packet, PACKET_SEQUENCE_ID, uint32_t(sequence));
+    put_bytes(packet, PACKET_TRACK_EVENT, scratch);
+    write_packet();
+
+    scratch.clear();
+    put_uint(scratch, EVENT_TYPE, SLICE_END);
+    put_uint(scratch, EVENT_TRACK_UUID, track);
+    put_uint(packet, PACKET_TIMESTAMP, ts + TRACE_NS_PER_CYCLE);
+    put_uint(packet, PACKET_SEQUENCE_ID, uint32_t(sequence));
+    put_bytes(packet, PACKET_TRACK_EVENT, scratch);
+    write_packet();
+}
+
+void PipelineTracer::write_record(const StageRecord &r)
+{
+    if (filter.rotate_bytes && file_bytes >= filter.rotate_bytes)
+    {
+        fclose(f);
+        file_index++;
+        if (!open_file())
+            exit(-1);
+    }
+    encode(r);
+}
+
+void PipelineTracer::run()
+{
+    StageRecord r;
+    unsigned idle = 0;
+    for (;;)
+    {
+        if (queue.pop(r))
+        {
+            write_record(r);
+            idle = 0;
+        }
+        else if (stopping.load(std::memory_order_acquire))
+        {
+            // The producer has stopped; anything left is already visible
+            while (queue.pop(r))
+                write_record(r);
+            return;
+        }
+        else if (++idle < 64)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+void PipelineTracer::close(std::ostream *os)
+{
+    if (!writer.joinable())
+        return;
+    stopping.store(true, std::memory_order_release);
+    writer.join();
+    fclose(f);
+    f = nullptr;
+    if (os)
+        *os << "Wrote " << recorded << " pipeline events to \"" << base << ".pftrace\""
+            << (file_index ? " and " + std::to_string(file_index) + " rotated files" : "") << std::endl;
+}
@@ -0,0 +1,93 @@
+#ifndef __INC__PIPELINE_TRACE_H__
+#define __INC__PIPELINE_TRACE_H__
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "spsc_queue.h"
+
+/*
+ * Pipeline stage events (log_pipeline_stage), written as a Perfetto trace
+ * (https://perfetto.dev, open in ui.perfetto.dev).
+ *
+ * The simulation thread filters each event and pushes a fixed-size binary
+ * record into a ring; a writer thread encodes the records as TrackEvent
+ * protobuf packets, one track per stage, and writes <base>.pftrace. With
+ * rotation the trace continues in <base>.1.pftrace, <base>.2.pftrace, ...,
+ * each of which opens on its own. Packets of different traces never share
+ * a sequence id or track uuid, so concatenated files (merge_trace.sh) are
+ * a valid trace too.
+ */
+
+#define PIPELINE_STAGES 5
+
+struct StageRecord
+{
+    uint64_t time;
+    int32_t stage;
+    int32_t fields[6]; // as passed to log_pipeline_stage
+};
+
+// Which events are kept (-O)
+struct TraceFilter
+{
+    uint32_t pc_low = 0, pc_high = UINT32_MAX; // pc:<LOW>-<HIGH>, inclusive
+    uint64_t from = 0, to = 0;                 // cycles:<FROM>[-<TO>]
+    unsigned stages = (1u << PIPELINE_STAGES) - 1; // stages:<FDRIC>
+    uint64_t rotate_bytes = 0;                 // rotate:<MB>, 0 = one file
+
+    bool parse(const char *spec);
+};
+
+class PipelineTracer
+{
+public:
+    ~PipelineTracer() { close(); }
+
+    // process_name labels the trace, e.g. the benchmark
+    bool open(const std::string &base, const std::string &process_name, const TraceFilter &filter);
+    bool is_open() const { return writer.joinable(); }
+
+    void record(uint64_t time, int stage, const int *fields)
+    {
+        uint64_t const cycle = time / 10;
+        if (!(filter.stages >> stage & 1) || uint32_t(fields[0]) < filter.pc_low || uint32_t(fields[0]) > filter.pc_high)
+            return;
+        if (cycle < filter.from || (filter.to && cycle >= filter.to))
+            return;
+        StageRecord const r {time, stage, {fields[0], fields[1], fields[2], fields[3], fields[4], fields[5]}};
+        while (!queue.push(r))
+            std::this_thread::yield();
+        recorded++;
+    }
+
+    // Drain the ring, finish the file and report to os
+    void close(std::ostream *os = nullptr);
+
+private:
+    SpscQueue<StageRecord, 1 << 16> queue;
+    std::thread writer;
+    std::atomic<bool> stopping {false};
+    TraceFilter filter;
+    uint64_t recorded = 0;
+
+    std::string base, process_name;
+    uint64_t sequence = 0; // trusted_packet_sequence_id, also the uuid base
+    FILE *f = nullptr;
+    unsigned file_index = 0;
+    uint64_t file_bytes = 0;
+    std::string packet, scratch, annotations; // encoding buffers
+
+    void run();
+    bool open_file();
+    void write_packet();
+    void write_descriptors();
+    void encode(const StageRecord &r);
+    void write_record(const StageRecord &r);
+};
+
+#endif
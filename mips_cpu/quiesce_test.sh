@@ -0,0 +1,25 @@
+#!/bin/bash
+set -e
+# Check that skipping quiet cycles (-q) leaves cycle counts and stats as
+# they are, and report how many cycles it skipped. Needs a model built with
+# make verilate SAVABLE=1.
+# Usage: ./quiesce_test.sh [benchmark]
+benchmark=${1:-quickSort}
+sim=${SIM:-obj_dir/Vmips_core}
+
+# Everything from the totals up to the host timings, which always differ
+report() {
+    sed -n '/^Total time:/,/^== Host/p' | grep -v '^== Host'
+}
+
+$sim -s -b $benchmark | report > $benchmark.full.report
+$sim -s -q -b $benchmark > $benchmark.quiesce.log
+report < $benchmark.quiesce.log > $benchmark.quiesce.report
+grep "^Skipped cycles:" $benchmark.quiesce.log || echo "Skipped cycles: 0"
+if diff $benchmark.full.report $benchmark.quiesce.report; then
+    echo "quiesce_test passed"
+    rm -f $benchmark.full.report $benchmark.quiesce.report $benchmark.quiesce.log
+else
+    echo "quiesce_test failed: $benchmark differs with -q" >&2
+    exit 1
+fi
@@ -0,0 +1,51 @@
+#ifndef __INC__RING_BUFFER_H__
+#define __INC__RING_BUFFER_H__
+
+#include <cassert>
+#include <cstddef>
+
+// Bounded FIFO with inline storage. Mirrors the subset of std::queue
+// the memory model uses, but never touches the heap.
+template <typename T, std::size_t N>
+class RingBuffer
+{
+public:
+    bool empty() const { return count == 0; }
+    bool full() const { return count == N; }
+    std::size_t size() const { return count; }
+    static constexpr std::size_t capacity() { return N; }
+
+    T &front() { return items[head]; }
+    const T &front() const { return items[head]; }
+
+    void push(const T &item)
+    {
+        assert(!full());
+        std::size_t tail = head + count;
+        if (tail >= N)
+            tail -= N;
+        items[tail] = item;
+        count++;
+    }
+
+    void pop()
+    {
+        assert(!empty());
+        if (++head == N)
+            head = 0;
+        count--;
+    }
+
+    void clear()
+    {
+        head = 0;
+        count = 0;
+    }
+
+private:
+    T items[N];
+    std::size_t head = 0;
+    std::size_t count = 0;
+};
+
+#endif
@@ -0,0 +1,18 @@
+#!/bin/bash
+set -e
+# Measure how the multithreaded model scales with the thread count.
+# Usage: ./scaling.sh [benchmark] [thread counts...]
+benchmark=${1:-quickSort}
+shift || true
+threads=${@:-1 2 4 8}
+
+echo "Scaling report for $benchmark"
+printf "%8s %16s %12s\n" "Threads" "Cycles/s" "Host time"
+
+for t in $threads; do
+    make -s verilate-mt THREADS=$t > /dev/null
+    out=$(obj_dir_mt$t/Vmips_core -sb $benchmark -j $t)
+    speed=$(echo "$out" | grep "Simulation speed:" | awk '{print $3}')
+    host=$(echo "$out" | grep "Host time:" | awk '{print $3}')
+    printf "%8s %16s %12s\n" "$t" "$speed" "$host"
+done
@@ -0,0 +1,243 @@
+#!/usr/bin/env python3
+"""SimPoint-style sampled simulation.
+
+  python3 simpoint.py [-b benchmark] [-n interval] [-k max_k] [-w warmup]
+                      [-s samples] [-j jobs] [--profile-only]
+
+1. bbv_profile runs the program on the ISS and writes one basic block vector
+   per interval of committed instructions (<benchmark>.bb).
+2. The vectors are randomly projected to 15 dimensions and clustered with
+   k-means; k is the smallest whose BIC reaches 90% of the best (as SimPoint
+   does). <benchmark>.simpoints / .weights list the chosen intervals.
+3. Each chosen interval is simulated in detail: the ISS fast-forwards to
+   <warmup> instructions before it (-F), those warm the core (-w), and the
+   interval itself is measured (-N).
+4. The per-cluster CPIs are combined with the cluster weights. Up to
+   <samples> intervals per cluster are simulated, which gives a stratified
+   sampling estimate of the error.
+"""
+import argparse
+import math
+import os
+import random
+import re
+import subprocess
+import sys
+from concurrent.futures import ThreadPoolExecutor
+
+DIMENSIONS = 15
+BIC_THRESHOLD = 0.9
+KMEANS_SEEDS = 5
+KMEANS_ITERATIONS = 100
+
+
+def find_image(benchmark):
+    base = os.path.join("..", "hexfiles", benchmark)
+    for ext in (".out", ".bin"):
+        if os.access(base + ext, os.R_OK):
+            return base + ext
+    return base + ".hex"
+
+
+def read_bbv(file_name):
+    """Sparse vectors {block id: instructions}, one per interval."""
+    vectors = []
+    with open(file_name) as f:
+        for line in f:
+            if not line.startswith("T"):
+                continue
+            v = {}
+            for block, count in re.findall(r":(\d+):(\d+)", line):
+                v[int(block)] = int(count)
+            vectors.append(v)
+    return vectors
+
+
+def project(vectors, seed):
+    """Normalise each vector and project it to DIMENSIONS dimensions."""
+    rng = random.Random(seed)
+    basis = {}
+    points = []
+    for v in vectors:
+        total = float(sum(v.values())) or 1.0
+        p = [0.0] * DIMENSIONS
+        for block in sorted(v):
+            if block not in basis:
+                basis[block] = [rng.uniform(-1.0, 1.0) for _ in range(DIMENSIONS)]
+            w = v[block] / total
+            row = basis[block]
+            for d in range(DIMENSIONS):
+                p[d] += w * row[d]
+        points.append(p)
+    return points
+
+
+def distance2(a, b):
+    return sum((x - y) * (x - y) for x, y in zip(a, b))
+
+
+def kmeans(points, k, rng):
+    # k-means++ seeding
+    centers = [list(rng.choice(points))]
+    while len(centers) < k:
+        d = [min(distance2(p, c) for c in centers) for p in points]
+        total = sum(d)
+        if total == 0:
+            centers.append(list(rng.choice(points)))
+            continue
+        r = rng.uniform(0, total)
+        for p, dp in zip(points, d):
+            r -= dp
+            if r <= 0:
+                break
+        centers.append(list(p))
+
+    labels = [0] * len(points)
+    for _ in range(KMEANS_ITERATIONS):
+        changed = False
+        for i, p in enumerate(points):
+            best = min(range(k), key=lambda c: distance2(p, centers[c]))
+            if best != labels[i]:
+                labels[i] = best
+                changed = True
+        for c in range(k):
+            members = [p for p, l in zip(points, labels) if l == c]
+            if members:
+                centers[c] = [sum(x) / len(members) for x in zip(*members)]
+        if not changed:
+            break
+    distortion = sum(distance2(p, centers[l]) for p, l in zip(points, labels))
+    return labels, centers, distortion
+
+
+def bic(points, labels, centers, k):
+    """Bayesian information criterion of a clustering (X-means formulation)."""
+    r, d = len(points), DIMENSIONS
+    distortion = sum(distance2(p, centers[l]) for p, l in zip(points, labels))
+    variance = max(distortion / max(r - k, 1), 1e-12)
+    likelihood = 0.0
+    for c in range(k):
+        rc = labels.count(c)
+        if rc == 0:
+            continue
+        likelihood += (rc * math.log(rc) - rc * math.log(r)
+                       - rc * d / 2.0 * math.log(2 * math.pi * variance)
+                       - (rc - 1) * d / 2.0)
+    parameters = (k - 1) + k * d + 1
+    return likelihood - parameters / 2.0 * math.log(r)
+
+
+def cluster(points, max_k, seed):
+    rng = random.Random(seed)
+    results = []
+    for k in range(1, min(max_k, len(points)) + 1):
+        best = min((kmeans(points, k, rng) for _ in range(KMEANS_SEEDS)), key=lambda x: x[2])
+        results.append((k, best[0], best[1], bic(points, best[0], best[1], k)))
+
+    scores = [r[3] for r in results]
+    low, high = min(scores), max(scores)
+    for k, labels, centers, score in results:
+        if high == low or (score - low) >= BIC_THRESHOLD * (high - low):
+            return k, labels, centers
+    return results[-1][:3]
+
+
+def simulate(args, start, length):
+    warmup = min(args.warmup, start)
+    command = [args.simulator, "-s", "-b", args.benchmark, "-N", str(length)]
+    if start - warmup:
+        command += ["-F", str(start - warmup)]
+    if warmup:
+        command += ["-w", str(warmup)]
+    out = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL,
+                         universal_newlines=True).stdout
+    instructions = re.search(r"Sample instructions: (\d+)", out)
+    cycles = re.search(r"Sample cycles: (\d+)", out)
+    if not instructions or not cycles or int(instructions.group(1)) == 0:
+        sys.exit("simulation of interval at %d failed:\n%s" % (start, " ".join(command)))
+    return int(cycles.group(1)) / float(instructions.group(1))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("-b", "--benchmark", default="quickSort")
+    parser.add_argument("-n", "--interval", type=int, default=1000000, help="instructions per interval")
+    parser.add_argument("-k", "--max-k", type=int, default=10, help="largest number of clusters tried")
+    parser.add_argument("-w", "--warmup", type=int, default=100000, help="detailed warm-up instructions")
+    parser.add_argument("-s", "--samples", type=int, default=2, help="intervals simulated per cluster")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count() or 1)
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--simulator", default="obj_dir/Vmips_core")
+    parser.add_argument("--profile-only", action="store_true", help="stop after writing the simpoints")
+    args = parser.parse_args()
+
+    bbv_file = args.benchmark + ".bb"
+    subprocess.check_call(["make", "-s", "bbv_profile"])
+    subprocess.check_call(["./bbv_profile", "-n", str(args.interval), find_image(args.benchmark), bbv_file])
+
+    vectors = read_bbv(bbv_file)
+    if not vectors:
+        sys.exit("no intervals in " + bbv_file)
+    sizes = [sum(v.values()) for v in vectors]
+    total = float(sum(sizes))
+    points = project(vectors, args.seed)
+    k, labels, centers = cluster(points, args.max_k, args.seed)
+
+    # Intervals of each cluster, closest to the centroid first
+    members = {c: sorted((i for i, l in enumerate(labels) if l == c),
+                         key=lambda i: distance2(points[i], centers[c]))
+               for c in set(labels)}
+    weights = {c: sum(sizes[i] for i in m) / total for c, m in members.items()}
+
+    with open(args.benchmark + ".simpoints", "w") as f:
+        for c in sorted(members):
+            f.write("%d %d\n" % (members[c][0], c))
+    with open(args.benchmark + ".weights", "w") as f:
+        for c in sorted(members):
+            f.write("%f %d\n" % (weights[c], c))
+
+    print("%d intervals of %d instructions, %d clusters" % (len(vectors), args.interval, k))
+    if args.profile_only:
+        return
+
+    chosen = [(c, i) for c in sorted(members) for i in members[c][:args.samples]]
+    with ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        cpis = list(pool.map(lambda ci: simulate(args, ci[1] * args.interval, sizes[ci[1]]), chosen))
+
+    samples = {c: [] for c in members}
+    for (c, i), cpi in zip(chosen, cpis):
+        samples[c].append(cpi)
+
+    # Stratified estimate. Clusters with one sample borrow the pooled
+    # within-cluster variance of the others.
+    pooled, dof = 0.0, 0
+    for s in samples.values():
+        if len(s) > 1:
+            mean = sum(s) / len(s)
+            pooled += sum((x - mean) ** 2 for x in s)
+            dof += len(s) - 1
+    pooled = pooled / dof if dof else 0.0
+
+    cpi = 0.0
+    variance = 0.0
+    print("%8s %10s %10s %8s %10s" % ("Cluster", "Interval", "Weight", "Samples", "CPI"))
+    for c in sorted(members):
+        s = samples[c]
+        mean = sum(s) / len(s)
+        if len(s) > 1:
+            var = sum((x - mean) ** 2 for x in s) / (len(s) - 1)
+        else:
+            var = pooled
+        cpi += weights[c] * mean
+        variance += weights[c] ** 2 * var / len(s)
+        print("%8d %10d %10.4f %8d %10.4f" % (c, members[c][0], weights[c], len(s), mean))
+
+    error = 1.96 * math.sqrt(variance)
+    detailed = sum(sizes[i] + min(args.warmup, i * args.interval) for _, i in chosen)
+    print("Detailed instructions: %d of %d (%.1f%%)" % (detailed, total, 100.0 * detailed / total))
+    print("CPI estimate: %f +- %f (95%%)  IPC estimate: %f +- %f" %
+          (cpi, error, 1.0 / cpi, error / (cpi * cpi)))
+
+
+if __name__ == "__main__":
+    main()
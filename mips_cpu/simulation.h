@@ -86,6 +86,17 @@ typedef enum {
 
 typedef enum {} Register; // need C++ to see this as a distinct type
 
+// log_pipeline_stage(PIPELINE_FLUSH_STAGE, pc, commit_index, ...): the
+// instruction committing flushes everything after it (flush_event)
+#define PIPELINE_FLUSH_STAGE 5
+// log_pipeline_stage(PIPELINE_DISPATCH_STAGE, pc, commit_index, ...): the
+// first cycle of the instruction in an execution unit (dispatch_event)
+#define PIPELINE_DISPATCH_STAGE 6
+
+// ls_event(op, addr, data): op is the MemAccessType of mips_core_pkg.sv
+#define LS_WRITE 0
+#define LS_READ  1
+
 static constexpr const char* to_string(Instruction const& ins) {
     switch (ins)
     {
@@ -0,0 +1,54 @@
+#ifndef __INC__SPSC_QUEUE_H__
+#define __INC__SPSC_QUEUE_H__
+
+#include <atomic>
+#include <cstddef>
+
+// Lock-free single-producer/single-consumer ring. N must be a power of two.
+// Each side caches the other side's index so the shared cache line is only
+// touched when the ring looks full (producer) or empty (consumer).
+template <typename T, std::size_t N>
+class SpscQueue
+{
+    static_assert((N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+
+public:
+    // Producer side, false when full
+    bool push(const T &item)
+    {
+        std::size_t h = head.load(std::memory_order_relaxed);
+        if (h - cached_tail == N)
+        {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (h - cached_tail == N)
+                return false;
+        }
+        items[h & (N - 1)] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side, false when empty
+    bool pop(T &item)
+    {
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        if (t == cached_head)
+        {
+            cached_head = head.load(std::memory_order_acquire);
+            if (t == cached_head)
+                return false;
+        }
+        item = items[t & (N - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    alignas(64) std::atomic<std::size_t> head{0}; // written by the producer
+    std::size_t cached_tail = 0;
+    alignas(64) std::atomic<std::size_t> tail{0}; // written by the consumer
+    std::size_t cached_head = 0;
+    alignas(64) T items[N];
+};
+
+#endif
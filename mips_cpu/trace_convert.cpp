@@ -0,0 +1,78 @@
+// Convert golden stream traces (text or binary, optionally .bz2) to the
+// binary delta+varint format read by the simulator.
+//
+//   trace_convert [-t] [-n FIELDS] <input> <output.trc>
+//
+// -t        the input is a legacy text trace dumped with -tt (time column)
+// -n FIELDS values per record; by default taken from the .pc/.wb/.ls name
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+#include "trace_file.h"
+
+static unsigned fields_from_name(const std::string &name)
+{
+    if (name.find(".pc.") != std::string::npos) return 1;
+    if (name.find(".wb.") != std::string::npos) return 2;
+    if (name.find(".ls.") != std::string::npos) return 3;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    bool legacy_timed = false;
+    unsigned field_count = 0;
+    while ((opt = getopt(argc, argv, "tn:")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            legacy_timed = true;
+            break;
+        case 'n':
+            field_count = std::stoi(optarg);
+            break;
+        default:
+            std::cerr << "Usage: " << argv[0] << " [-t] [-n fields] <input> <output.trc>" << std::endl;
+            return -1;
+        }
+    }
+    if (argc - optind != 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " [-t] [-n fields] <input> <output.trc>" << std::endl;
+        return -1;
+    }
+
+    std::string const input(argv[optind]), output(argv[optind + 1]);
+    if (field_count == 0)
+        field_count = fields_from_name(input);
+    if (field_count == 0 || field_count > TRACE_MAX_FIELDS)
+    {
+        std::cerr << "Cannot tell the record size of " << input << ", use -n" << std::endl;
+        return -1;
+    }
+
+    TraceReader reader;
+    if (!reader.open(input, field_count, legacy_timed))
+    {
+        std::cerr << "Failed to open file: " << input << std::endl;
+        return -1;
+    }
+    TraceWriter writer;
+    if (!writer.open(output, field_count, reader.timed()))
+    {
+        std::cerr << "Failed to open file: " << output << std::endl;
+        return -1;
+    }
+
+    uint32_t fields[TRACE_MAX_FIELDS];
+    uint64_t time;
+    while (reader.next(fields, &time))
+        writer.write(time, fields);
+    writer.close();
+
+    std::cout << input << " -> " << output << ": " << reader.position() << " records" << std::endl;
+    return 0;
+}
@@ -0,0 +1,325 @@
+#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "trace_file.h"
+
+static const char TRACE_MAGIC[4] = {'M', 'T', 'R', 'C'};
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 8
+
+static bool ends_with(const std::string &s, const char *suffix)
+{
+    size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static inline uint32_t zigzag(uint32_t delta)
+{
+    return (delta << 1) ^ uint32_t(int32_t(delta) >> 31);
+}
+
+static inline uint32_t unzigzag(uint32_t value)
+{
+    return (value >> 1) ^ (0u - (value & 1));
+}
+
+static inline uint8_t *put_varint(uint8_t *p, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *p++ = uint8_t(value) | 0x80;
+        value >>= 7;
+    }
+    *p++ = uint8_t(value);
+    return p;
+}
+
+static inline bool get_varint(const uint8_t *&p, const uint8_t *end, uint64_t &value)
+{
+    value = 0;
+    for (unsigned shift = 0; p < end && shift < 64; shift += 7)
+    {
+        uint8_t b = *p++;
+        value |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// =====================================================================
+// TraceWriter
+// =====================================================================
+
+bool TraceWriter::open(const std::string &file_name, unsigned field_count, bool timed)
+{
+    close();
+    f = fopen(file_name.c_str(), "wb");
+    if (f == NULL)
+        return false;
+
+    this->field_count = field_count;
+    this->timed = timed;
+    previous_time = 0;
+    memset(previous, 0, sizeof(previous));
+
+    uint8_t header[TRACE_HEADER_SIZE] = {0};
+    memcpy(header, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header[4] = TRACE_VERSION;
+    header[5] = field_count;
+    header[6] = timed ? TRACE_TIMED : 0;
+    fwrite(header, 1, sizeof(header), f);
+    return true;
+}
+
+void TraceWriter::write(uint64_t time, const uint32_t *fields)
+{
+    if (used + 10 * (TRACE_MAX_FIELDS + 1) > sizeof(buffer))
+        flush();
+
+    uint8_t *p = buffer + used;
+    if (timed)
+    {
+        p = put_varint(p, time - previous_time);
+        previous_time = time;
+    }
+    for (unsigned i = 0; i < field_count; i++)
+    {
+        p = put_varint(p, zigzag(fields[i] - previous[i]));
+        previous[i] = fields[i];
+    }
+    used = p - buffer;
+}
+
+void TraceWriter::flush()
+{
+    if (used > 0)
+        fwrite(buffer, 1, used, f);
+    used = 0;
+}
+
+void TraceWriter::close()
+{
+    if (f == NULL)
+        return;
+    flush();
+    fclose(f);
+    f = NULL;
+}
+
+// =====================================================================
+// TraceReader
+// =====================================================================
+
+bool TraceReader::open(const std::string &file_name, unsigned field_count, bool legacy_timed)
+{
+    close();
+    this->field_count = field_count;
+
+    if (ends_with(file_name, ".bz2"))
+    {
+        compressed = fopen(file_name.c_str(), "rb");
+        if (compressed == NULL)
+            return false;
+        int error;
+        bz = BZ2_bzReadOpen(&error, compressed, 0, 0, NULL, 0);
+        if (error != BZ_OK)
+        {
+            std::cerr << "Failed to decompress file: " << file_name << std::endl;
+            close();
+            return false;
+        }
+        window = new uint8_t[WINDOW];
+        begin = end = window;
+        exhausted = false;
+        source = BZIP2;
+        refill();
+    }
+    else
+    {
+        int fd = ::open(file_name.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                map = static_cast<const uint8_t *>(p);
+                map_size = st.st_size;
+                madvise(p, map_size, MADV_SEQUENTIAL);
+            }
+        }
+        ::close(fd);
+        begin = map;
+        end = map + map_size;
+        exhausted = true;
+        source = MAPPED;
+    }
+
+    if (end - begin >= TRACE_HEADER_SIZE && memcmp(begin, TRACE_MAGIC, sizeof(TRACE_MAGIC)) == 0)
+    {
+        if (begin[4] != TRACE_VERSION || begin[5] != field_count)
+        {
+            std::cerr << "Unexpected trace version or field count in: " << file_name << std::endl;
+            close();
+            return false;
+        }
+        format = BINARY;
+        flags = begin[6];
+        begin += TRACE_HEADER_SIZE;
+    }
+    else
+    {
+        format = TEXT;
+        flags = legacy_timed ? TRACE_TIMED : 0;
+    }
+    return true;
+}
+
+void TraceReader::close()
+{
+    if (map != NULL)
+        munmap(const_cast<uint8_t *>(map), map_size);
+    if (bz != NULL)
+    {
+        int error;
+        BZ2_bzReadClose(&error, bz);
+    }
+    if (compressed != NULL)
+        fclose(compressed);
+    delete[] window;
+
+    map = NULL;
+    map_size = 0;
+    bz = NULL;
+    compressed = NULL;
+    window = NULL;
+    begin = end = NULL;
+    source = NONE;
+    previous_time = 0;
+    memset(previous, 0, sizeof(previous));
+    decoded = cursor = 0;
+    consumed = 0;
+}
+
+// Slide the undecoded tail to the front of the window and decompress
+// behind it. Only compressed traces ever need more bytes.
+bool TraceReader::refill()
+{
+    if (source != BZIP2 || exhausted)
+        return false;
+
+    size_t remaining = end - begin;
+    memmove(window, begin, remaining);
+    begin = window;
+    end = window + remaining;
+
+    while (!exhausted && end < window + WINDOW)
+    {
+        int error;
+        int n = BZ2_bzRead(&error, bz, const_cast<uint8_t *>(end), window + WINDOW - end);
+        if (error == BZ_OK || error == BZ_STREAM_END)
+            end += n;
+        if (error != BZ_OK)
+            exhausted = true;
+    }
+    return end - begin > ptrdiff_t(remaining);
+}
+
+bool TraceReader::decode_block()
+{
+    decoded = cursor = 0;
+    while (decoded < BLOCK)
+    {
+        if (end - begin < ptrdiff_t(MAX_RECORD_BYTES))
+            refill();
+        bool ok = format == BINARY ? decode_binary(decoded) : decode_text(decoded);
+        if (!ok)
+            break;
+        decoded++;
+    }
+    return decoded > 0;
+}
+
+// The deltas only become the new previous record once all of it was read,
+// so a record cut short leaves the reader where it was
+bool TraceReader::decode_binary(size_t index)
+{
+    const uint8_t *p = begin;
+    uint64_t value;
+
+    uint64_t time = 0;
+    if (flags & TRACE_TIMED)
+    {
+        if (!get_varint(p, end, value))
+            return false;
+        time = previous_time + value;
+    }
+    uint32_t fields[TRACE_MAX_FIELDS];
+    for (unsigned i = 0; i < field_count; i++)
+    {
+        if (!get_varint(p, end, value))
+            return false;
+        fields[i] = previous[i] + unzigzag(uint32_t(value));
+    }
+
+    times[index] = previous_time = time;
+    for (unsigned i = 0; i < field_count; i++)
+        records[index * field_count + i] = previous[i] = fields[i];
+    begin = p;
+    return true;
+}
+
+static inline bool parse_token(const uint8_t *&p, const uint8_t *end, unsigned base, uint64_t &value)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+        p++;
+    if (base == 16 && end - p >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+        p += 2;
+
+    const uint8_t *start = p;
+    value = 0;
+    for (; p < end; p++)
+    {
+        unsigned digit;
+        if (*p >= '0' && *p <= '9')
+            digit = *p - '0';
+        else if (base == 16 && *p >= 'a' && *p <= 'f')
+            digit = *p - 'a' + 10;
+        else if (base == 16 && *p >= 'A' && *p <= 'F')
+            digit = *p - 'A' + 10;
+        else
+            break;
+        value = value * base + digit;
+    }
+    return p != start;
+}
+
+bool TraceReader::decode_text(size_t index)
+{
+    const uint8_t *p = begin;
+    uint64_t value;
+
+    times[index] = 0;
+    if (flags & TRACE_TIMED)
+    {
+        if (!parse_token(p, end, 10, value))
+            return false;
+        times[index] = value;
+    }
+    uint32_t *fields = records + index * field_count;
+    for (unsigned i = 0; i < field_count; i++)
+    {
+        if (!parse_token(p, end, 16, value))
+            return false;
+        fields[i] = uint32_t(value);
+    }
+    begin = p;
+    return true;
+}
@@ -0,0 +1,132 @@
+#ifndef __INC__TRACE_FILE_H__
+#define __INC__TRACE_FILE_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include <bzlib.h>
+
+/*
+ * Golden stream traces (pc / wb / ls events).
+ *
+ * Binary format (*.trc):
+ *   header  "MTRC" | version | field count | flags | reserved   (8 bytes)
+ *   record  [time delta] field deltas...
+ * Every value is stored as the difference to the same field of the previous
+ * record, zigzag encoded into an LEB128 varint, so a sequential pc costs one
+ * byte. Time (TRACE_TIMED, written by -tt) is monotonic and stored unsigned.
+ *
+ * TraceReader also accepts the legacy text traces (whitespace separated hex
+ * values, one record per line) and bzip2 compressed files (*.bz2) of either
+ * format, which are decompressed while streaming.
+ */
+
+#define TRACE_MAX_FIELDS 3
+#define TRACE_TIMED 0x01
+
+class TraceWriter
+{
+public:
+    ~TraceWriter() { close(); }
+
+    bool open(const std::string &file_name, unsigned field_count, bool timed);
+    bool is_open() const { return f != NULL; }
+    void write(uint64_t time, const uint32_t *fields);
+    void close();
+
+private:
+    FILE *f = NULL;
+    unsigned field_count = 0;
+    bool timed = false;
+    uint64_t previous_time = 0;
+    uint32_t previous[TRACE_MAX_FIELDS] = {};
+
+    uint8_t buffer[1 << 16];
+    size_t used = 0;
+
+    void flush();
+};
+
+class TraceReader
+{
+public:
+    ~TraceReader() { close(); }
+
+    // legacy_timed: a text trace whose records start with a decimal time (-tt)
+    bool open(const std::string &file_name, unsigned field_count, bool legacy_timed = false);
+    bool is_open() const { return source != NONE; }
+    void close();
+
+    // Next record, false once the trace is exhausted
+    bool next(uint32_t *fields, uint64_t *time = NULL)
+    {
+        if (cursor == decoded && !decode_block())
+            return false;
+        for (unsigned i = 0; i < field_count; i++)
+            fields[i] = records[cursor * field_count + i];
+        if (time)
+            *time = times[cursor];
+        cursor++;
+        consumed++;
+        return true;
+    }
+
+    // Drop the next count records, e.g. to resume from a checkpoint
+    bool skip(uint64_t count)
+    {
+        uint32_t fields[TRACE_MAX_FIELDS];
+        while (count--)
+        {
+            if (!next(fields))
+                return false;
+        }
+        return true;
+    }
+
+    // Number of records returned by next() so far
+    uint64_t position() const { return consumed; }
+
+    bool timed() const { return flags & TRACE_TIMED; }
+
+private:
+    enum Source { NONE, MAPPED, BZIP2 };
+    enum Format { BINARY, TEXT };
+
+    static constexpr size_t BLOCK = 4096;           // records decoded at a time
+    static constexpr size_t WINDOW = 1 << 20;       // bzip2 decompression window
+    static constexpr size_t MAX_RECORD_BYTES = 256; // longest record we parse
+
+    Source source = NONE;
+    Format format = BINARY;
+    unsigned field_count = 0;
+    unsigned flags = 0;
+
+    // Undecoded bytes [begin, end) of either the mapping or the window
+    const uint8_t *begin = NULL;
+    const uint8_t *end = NULL;
+    bool exhausted = false;
+
+    const uint8_t *map = NULL;
+    size_t map_size = 0;
+
+    FILE *compressed = NULL;
+    BZFILE *bz = NULL;
+    uint8_t *window = NULL;
+
+    uint32_t previous[TRACE_MAX_FIELDS] = {};
+    uint64_t previous_time = 0;
+
+    uint32_t records[BLOCK * TRACE_MAX_FIELDS];
+    uint64_t times[BLOCK];
+    size_t decoded = 0;
+    size_t cursor = 0;
+    uint64_t consumed = 0;
+
+    bool refill();
+    bool decode_block();
+    bool decode_binary(size_t index);
+    bool decode_text(size_t index);
+};
+
+#endif
@@ -0,0 +1,222 @@
+// Round-trips golden stream traces through TraceWriter and TraceReader.
+//
+//   trace_test [golden...]
+//
+// Without arguments it checks made-up .pc/.wb/.ls streams: binary, timed,
+// bzip2 compressed and cut short in the middle of a record. Each golden
+// trace given (text or binary, optionally .bz2, as trace_convert takes them)
+// is written back as binary and must read back record for record.
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "trace_file.h"
+
+struct Record
+{
+    uint64_t time;
+    uint32_t fields[TRACE_MAX_FIELDS];
+};
+
+static unsigned fields_from_name(const std::string &name)
+{
+    if (name.find(".pc.") != std::string::npos) return 1;
+    if (name.find(".wb.") != std::string::npos) return 2;
+    if (name.find(".ls.") != std::string::npos) return 3;
+    return 0;
+}
+
+static std::string temp_name(const char *suffix)
+{
+    return "/tmp/trace_test." + std::to_string(getpid()) + suffix;
+}
+
+// Mostly sequential pcs with jumps back and forth, registers, addresses and
+// data that use the full 32 bits
+static std::vector<Record> make_stream(unsigned field_count, size_t count)
+{
+    std::mt19937 rng(field_count);
+    std::vector<Record> records(count);
+    uint64_t time = 0;
+    uint32_t pc = 0x400000;
+    for (Record &r : records)
+    {
+        time += rng() % 8 == 0 ? rng() % 1000 : 10;
+        pc = rng() % 16 == 0 ? rng() : pc + 4;
+        r.time = time;
+        r.fields[0] = field_count == 1 ? pc : field_count == 2 ? rng() % 32 : rng() % 2;
+        r.fields[1] = field_count == 3 ? 0x10000000 + (rng() % 4096) * 4 : rng();
+        r.fields[2] = rng();
+    }
+    return records;
+}
+
+static bool write_trace(const std::string &file_name, unsigned field_count, bool timed, const std::vector<Record> &records)
+{
+    TraceWriter writer;
+    if (!writer.open(file_name, field_count, timed))
+    {
+        std::cerr << "Failed to open file: " << file_name << std::endl;
+        return false;
+    }
+    for (const Record &r : records)
+        writer.write(r.time, r.fields);
+    return true;
+}
+
+static bool read_trace(const std::string &file_name, unsigned field_count, std::vector<Record> &records, bool *timed = NULL)
+{
+    TraceReader reader;
+    if (!reader.open(file_name, field_count))
+    {
+        std::cerr << "Failed to open file: " << file_name << std::endl;
+        return false;
+    }
+    if (timed)
+        *timed = reader.timed();
+    Record r = {};
+    while (reader.next(r.fields, &r.time))
+        records.push_back(r);
+    // Stays exhausted
+    if (reader.next(r.fields, &r.time))
+    {
+        std::cerr << file_name << ": record after the end of the trace" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static bool compress(const std::string &from, const std::string &to)
+{
+    FILE *in = fopen(from.c_str(), "rb");
+    FILE *out = fopen(to.c_str(), "wb");
+    int error = BZ_IO_ERROR;
+    if (in != NULL && out != NULL)
+    {
+        BZFILE *bz = BZ2_bzWriteOpen(&error, out, 9, 0, 0);
+        char buffer[1 << 16];
+        size_t n;
+        while (error == BZ_OK && (n = fread(buffer, 1, sizeof(buffer), in)) > 0)
+            BZ2_bzWrite(&error, bz, buffer, n);
+        int close_error;
+        BZ2_bzWriteClose(&close_error, bz, 0, NULL, NULL);
+    }
+    if (in != NULL)
+        fclose(in);
+    if (out != NULL)
+        fclose(out);
+    return error == BZ_OK;
+}
+
+static void print_record(const Record &r, unsigned field_count, bool timed)
+{
+    if (timed)
+        std::cerr << " " << r.time;
+    std::cerr << std::hex;
+    for (unsigned f = 0; f < field_count; f++)
+        std::cerr << " " << r.fields[f];
+    std::cerr << std::dec;
+}
+
+// First record that differs, like diff would show it
+static bool expect(const std::string &what, unsigned field_count, bool timed,
+                   const std::vector<Record> &actual, const std::vector<Record> &expected)
+{
+    for (size_t i = 0; i < actual.size() && i < expected.size(); i++)
+    {
+        bool same = !timed || actual[i].time == expected[i].time;
+        for (unsigned f = 0; f < field_count; f++)
+            same &= actual[i].fields[f] == expected[i].fields[f];
+        if (same)
+            continue;
+        std::cerr << what << ": record " << i << " is";
+        print_record(actual[i], field_count, timed);
+        std::cerr << ", expected";
+        print_record(expected[i], field_count, timed);
+        std::cerr << std::endl;
+        return false;
+    }
+    if (actual.size() == expected.size())
+        return true;
+    std::cerr << what << ": " << actual.size() << " records, expected " << expected.size() << std::endl;
+    return false;
+}
+
+static bool check_stream(unsigned field_count, bool timed)
+{
+    std::string const what = std::string(field_count == 1 ? "pc" : field_count == 2 ? "wb" : "ls") + (timed ? " timed" : "");
+    std::string const file_name = temp_name(".trc");
+    std::string const bz2_name = file_name + ".bz2";
+
+    // Spans several decode blocks and, compressed, several windows
+    std::vector<Record> const expected = make_stream(field_count, 300000);
+    std::vector<Record> binary, compressed, truncated;
+    bool ok = write_trace(file_name, field_count, timed, expected) &&
+              read_trace(file_name, field_count, binary) &&
+              compress(file_name, bz2_name) &&
+              read_trace(bz2_name, field_count, compressed);
+    ok = ok && expect(what, field_count, timed, binary, expected);
+    ok = ok && expect(what + " bz2", field_count, timed, compressed, expected);
+
+    // The last record loses its final byte and is dropped as a whole
+    std::vector<Record> const shorter(expected.begin(), expected.end() - 1);
+    long size = 0;
+    if (FILE *f = fopen(file_name.c_str(), "rb"))
+    {
+        fseek(f, 0, SEEK_END);
+        size = ftell(f);
+        fclose(f);
+    }
+    ok = ok && truncate(file_name.c_str(), size - 1) == 0 &&
+         read_trace(file_name, field_count, truncated) &&
+         expect(what + " truncated", field_count, timed, truncated, shorter);
+
+    unlink(file_name.c_str());
+    unlink(bz2_name.c_str());
+    return ok;
+}
+
+static bool check_golden(const std::string &golden)
+{
+    unsigned const field_count = fields_from_name(golden);
+    if (field_count == 0)
+    {
+        std::cerr << "Cannot tell the record size of " << golden << std::endl;
+        return false;
+    }
+    std::string const file_name = temp_name(".trc");
+    std::vector<Record> expected, actual;
+    bool timed = false;
+    bool const ok = read_trace(golden, field_count, expected, &timed) &&
+                    write_trace(file_name, field_count, timed, expected) &&
+                    read_trace(file_name, field_count, actual) &&
+                    expect(golden, field_count, timed, actual, expected);
+    unlink(file_name.c_str());
+    if (ok)
+        std::cout << golden << ": " << expected.size() << " records" << std::endl;
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    bool ok = true;
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; i++)
+            ok &= check_golden(argv[i]);
+    }
+    else
+    {
+        for (unsigned field_count = 1; field_count <= TRACE_MAX_FIELDS; field_count++)
+        {
+            ok &= check_stream(field_count, false);
+            ok &= check_stream(field_count, true);
+        }
+    }
+
+    std::cout << (ok ? "trace_test passed" : "trace_test FAILED") << std::endl;
+    return ok ? 0 : -1;
+}
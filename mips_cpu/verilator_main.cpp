@@ -7,513 +7,2118 @@
 #include <unordered_map>
 #include <unistd.h>
 #include <iomanip>
+#include <algorithm>
 #include <type_traits>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <sys/wait.h>
+#include <glob.h>
+#include <cstring>
+#include <set>
+#include <cinttypes>
+#include <mutex>
+#include <sys/resource.h>
 #include "Vmips_core.h"
 #include "verilated_fst_c.h"
 #include "Vmips_core__Dpi.h"
 #include "memory_driver.h"
 #include "memory.h"
 #include "simulation.h"
+#include "trace_file.h"
+#include "spsc_queue.h"
+#include "iss.h"
+#include "checkpoint.h"
+#include "pipeline_trace.h"
+#include "kanata_log.h"
+#include "pc_profile.h"
+#include "latency_profile.h"
+#ifdef SIM_SAVABLE
+#include "verilated_save.h"
+
+// The model serialized into memory, as it would be into a checkpoint
+class ModelSnapshot : public VerilatedSerialize
+{
+public:
+    std::vector<uint8_t> data;
 
-Vmips_core   *top; // Instantiation of module
-MemoryDriver *memory_driver;
-Memory       *memory;
+    void take(Vmips_core &model)
+    {
+        data.clear();
+        *this << model;
+        flush();
+    }
+    void flush() override
+    {
+        data.insert(data.end(), m_bufp, m_cp);
+        m_cp = m_bufp;
+    }
+};
+#endif
 
 // *****************************************************
 // |   SIMULATOR INPUT                                 |
 // *****************************************************
-int prediction = 0;
-int correct = 0;
-int total_btb_used = 0;
 int memory_debug         = 0;         // -m
 int stream_dump          = 0;         // -d
 int stream_print         = 0;         // -p
 int stream_check         = 1;         // -s
+int stream_async         = 1;         // -S clears (check streams on the simulation thread)
 int _debug_level         = 0;         // -l <LEVEL>
-const char *benchmark    = "nqueens"; // -b <BENCHMARK>
-const char *output_trace = nullptr;   // -o <FILE>
+const char *benchmarks   = "nqueens"; // -b <BENCHMARK>[,<BENCHMARK>...]
+const char *output_trace = nullptr;   // -o <FILE> (FILE.pftrace)
+TraceFilter trace_filter;             // -O <FILTER>
+const char *kanata_file  = nullptr;   // -k <FILE>
+int pc_profile           = 0;         // -A
+int latency_profile      = 0;         // -L
+int host_profile         = 0;         // -P
+const char *memory_image = nullptr;   // -i <FILE> (default: hexfiles/<BENCHMARK>.{out,bin,hex})
+int wave_dump            = 0;         // -d, -D <SPEC>
+double memory_delay_factor = 1.0;     // -f <FACTOR>
+int sim_threads          = 0;         // -j <THREADS> (0 = as verilated)
+unsigned parallel_runs   = 0;         // -T <THREADS> (0 = one per host thread)
+int reuse_model          = 0;         // -r
+int quiesce              = 0;         // -q
+int cosim                = 0;         // -c
+uint64_t fast_forward    = 0;         // -F <INSTRUCTIONS>
+uint64_t sample_warmup   = 0;         // -w <INSTRUCTIONS>
+uint64_t sample_length   = 0;         // -N <INSTRUCTIONS> (0 = run to completion)
+uint64_t checkpoint_cycle = 0;        // -C <CYCLE>
+const char *restore_file = nullptr;   // -R <FILE>
+uint64_t sweep_cycle     = 0;         // -W <CYCLE>
+uint64_t series_interval = 0;         // -I <CYCLES>[,<FILE>]
+const char *series_file  = nullptr;   // (default: <BENCHMARK>.series.csv)
+int64_t sweep_pc         = -1;        // -W pc:<PC>
 // *****************************************************
 // *****************************************************
 
 // std::string hexfiles_dir = "/home/linux/ieng6/cs148sp22/public";
 std::string hexfiles_dir = "..";
 
-vluint64_t main_time = 0; // Current simulation time
-// This is a 64-bit integer to reduce wrap over issues and
-// allow modulus.  This is in units of the timeprecision
-// used in Verilog (or from --timescale-override)
+// Set by SIGINT; every running simulation winds down as on a mismatch
+volatile std::sig_atomic_t signal_received = 0;
+
+void on_signal(int signal)
+{
+    signal_received = signal;
+}
+
+#define CYCLES(TIME) ((TIME)/10) // time to Cycle count
+
+int debug_level() {
+    //if (CYCLES(main_time) < 12607) return 0;
+    return _debug_level;
+}
+
+const char* alu_ctl_to_string(int alu_ctl) {
+    auto op = ALU_Operation(alu_ctl);
+    return to_string(op);
+}
+
+const char* mips_reg_to_string(int index) {
+    auto reg = Register(index);
+    return to_string(reg);
+}
+
+// Golden trace of one kind of stream event, hexfiles/<BENCHMARK>.<suffix>.*
+// Files are opened on the first event, as not every core emits every stream.
+struct EventStream
+{
+    const char *suffix;
+    unsigned field_count;
+    std::string benchmark;
+    TraceReader golden;
+    TraceWriter dump;
+
+    EventStream(const char *suffix, unsigned field_count, const std::string &benchmark)
+        : suffix(suffix), field_count(field_count), benchmark(benchmark) {}
+
+    std::string file_name(const char *ext) const
+    {
+        return hexfiles_dir + "/hexfiles/" + benchmark + "." + suffix + ext;
+    }
+
+    void record(uint64_t time, const uint32_t *fields)
+    {
+        if (!dump.is_open())
+        {
+            std::string const fname(file_name(".trc"));
+            if (!dump.open(fname, field_count, stream_dump >= 2))
+            {
+                std::cerr << "Failed to open file: " << fname << std::endl;
+                exit(-1);
+            }
+        }
+        dump.write(time, fields);
+    }
+
+    void open_golden()
+    {
+        // Converted traces first, then the legacy text dumps
+        for (auto ext : {".trc", ".trc.bz2", ".txt", ".txt.bz2"})
+        {
+            if (golden.open(file_name(ext), field_count))
+                return;
+        }
+        std::cerr << "Failed to open file: " << file_name(".trc") << std::endl;
+        exit(-1);
+    }
+
+    bool expect(uint32_t *fields)
+    {
+        if (!golden.is_open())
+            open_golden();
+        return golden.next(fields);
+    }
+
+    // Continue checking from the position saved in a checkpoint
+    void seek(uint64_t position)
+    {
+        open_golden();
+        if (!golden.skip(position))
+        {
+            std::cerr << "Golden trace " << suffix << " is shorter than the checkpoint expects" << std::endl;
+            exit(-1);
+        }
+    }
+
+    void close()
+    {
+        dump.close();
+        golden.close();
+    }
+};
+
+enum StreamKind { STREAM_PC, STREAM_WB, STREAM_LS };
+
+struct StreamEvent
+{
+    uint64_t time;
+    uint32_t kind;
+    uint32_t fields[TRACE_MAX_FIELDS];
+};
+
+// *****************************************************
+// |   CHECKPOINTS (-C / -R)                           |
+// *****************************************************
+// A checkpoint holds the harness state (the counters, stats, gauges, golden trace
+// positions and the ISS of a Simulation), the memory model and, after it,
+// the Verilated model. Trace dumps (-t, -o, -d) are not resumed.
+#define CHECKPOINT_MAGIC 0x504b434d // "MCKP"
+#define CHECKPOINT_VERSION 3
+
+// *****************************************************
+// |   SWEEPS (-W / -X)                                |
+// *****************************************************
+// At the sweep point the simulator forks one child per memory configuration.
+// The children share the warmed state copy-on-write, run to the end and
+// report through a pipe; the parent prints one table and exits.
+struct SweepConfig
+{
+    double delay_factor;
+    unsigned read_limit, write_limit;
+};
+
+struct SweepResult
+{
+    uint64_t cycles;       // since the sweep point
+    uint64_t instructions; // since the sweep point
+    int aborted;
+};
+
+std::vector<SweepConfig> sweep_configs; // -X
+
+// *****************************************************
+// |   WAVEFORM WINDOWS (-D)                           |
+// *****************************************************
+// simx.fst is opened when the window starts and closed when it ends, so a
+// run costs next to nothing until the point of interest. The window starts
+// at the first of its start conditions (immediately if none is given).
+struct WaveSpec
+{
+    uint64_t from = 0, to = 0; // cycles:<FROM>[-<TO>]
+    int64_t pc = -1;           // pc:<PC>, its first commit
+    uint64_t commit = 0;       // commit:<N>, the Nth commit
+    std::string stat_name;     // stat:<NAME>, the first count of that counter
+    int stat = -1;             // its handle, once the model has registered it
+    bool mismatch = false;     // mismatch, a stream or co-simulation mismatch
+    uint64_t length = 0;       // length:<CYCLES> dumped from the start
+    std::string scope;         // scope:<NAME>, dump only this instance
+    int depth = 1024;          // depth:<LEVELS> below it
+
+    bool triggered() const { return from || pc >= 0 || commit || !stat_name.empty() || mismatch; }
+};
+
+WaveSpec wave_spec; // -D
+
+// CPI stack, the counters mips_core.sv charges each cycle to (cpi_<name>)
+#define CPI_CATEGORIES 10
+static constexpr const char *cpi_categories[CPI_CATEGORIES] = {
+    "base",      // committing
+    "icache",    // commit queue empty behind an i-cache miss
+    "branch",    // commit queue empty after a misprediction
+    "dcache",    // the load at the head waiting on the d-cache
+    "sq_full",   // a store cannot enter the store queue
+    "cq_full",   // rename stalled on a full commit queue
+    "fl_empty",  // rename waiting for a free register
+    "iq_starve", // head waiting and nothing issued completes
+    "exec",      // head still executing while others complete
+    "reset",     // held in reset
+};
+
+// One row of the benchmark table, with the report of the run
+struct RunResult
+{
+    std::string benchmark;
+    unsigned cycles, instructions;
+    int br_miss, ic_miss;
+    int correct, prediction;
+    uint64_t cpi_stack[CPI_CATEGORIES];
+    bool aborted;
+    std::string report;
+};
+
+// *****************************************************
+// |   HOST PROFILE (-P)                               |
+// *****************************************************
+// Where the simulator's own time goes. Each part of the run loop and each
+// DPI hook runs under a HostTimer; nested timers (the hooks run inside
+// eval) are taken out of the enclosing one, so every nanosecond counts once.
+enum HostComponent
+{
+    HOST_EVAL,          // top->eval(), less the DPI hooks it calls
+    HOST_MEMORY_DRIVER, // MemoryDriver::consume and drive
+    HOST_MEMORY,        // Memory::process
+    HOST_DPI,           // pc_event, log_pipeline_stage, stats_increment...
+    HOST_STREAMS,       // printing, dumping and checking the event streams
+    HOST_WAVES,         // -d/-D waveform triggers and dumps
+    HOST_COMPONENTS
+};
+
+static constexpr const char *host_component_names[HOST_COMPONENTS] = {
+    "eval",
+    "memory driver",
+    "memory",
+    "DPI hooks",
+    "stream checking",
+    "waveforms",
+};
+
+struct HostProfile
+{
+    uint64_t ns[HOST_COMPONENTS] = {};
+    uint64_t calls[HOST_COMPONENTS] = {};
+};
+
+struct HostTimer
+{
+    uint64_t *ns = nullptr; // the component's, nullptr without -P
+    uint64_t children = 0;
+    HostTimer *parent = nullptr;
+    std::chrono::steady_clock::time_point start;
+
+    static thread_local HostTimer *innermost;
+
+    HostTimer(HostProfile &profile, HostComponent component)
+    {
+        if (!host_profile)
+            return;
+        ns = &profile.ns[component];
+        profile.calls[component]++;
+        parent = innermost;
+        innermost = this;
+        start = std::chrono::steady_clock::now();
+    }
+
+    ~HostTimer()
+    {
+        if (!ns)
+            return;
+        uint64_t const elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        *ns += elapsed - children;
+        if (parent)
+            parent->children += elapsed;
+        innermost = parent;
+    }
+};
+
+thread_local HostTimer *HostTimer::innermost = nullptr;
+
+/*
+ * One benchmark on its own VerilatedContext, model and memory. Everything
+ * a run changes lives here, so several can run side by side on a thread
+ * pool (-b a,b,c); the DPI hooks find theirs through sim(). reload()
+ * starts another program on the same model (-r).
+ */
+struct Simulation
+{
+    std::string benchmark;
+    std::ostream &out; // report and diagnostics
+    std::ostream &err;
+
+    VerilatedContext *contextp = nullptr;
+    Vmips_core   *top = nullptr; // Instantiation of module
+    MemoryDriver *memory_driver = nullptr;
+    Memory       *memory = nullptr;
+    VerilatedFstC *tfp = nullptr;
+    PipelineTracer tracer;
+    KanataLog kanata;
+    PcProfile profile; // -A
+    LatencyProfile latency; // -L
+    bool wave_triggered = false; // a -D trigger fired
+    bool wave_done = false;
+    vluint64_t wave_end_time = 0;
+
+    vluint64_t main_time = 0; // Current simulation time
+    // This is a 64-bit integer to reduce wrap over issues and
+    // allow modulus.  This is in units of the timeprecision
+    // used in Verilog (or from --timescale-override)
+
+    std::atomic<int> interrupt {0}; // set by mismatches and signal_handler
+    vluint64_t stop_time = 0;
+    double host_seconds = 0;
+    HostProfile host; // -P
+
+    std::vector<uint64_t> stats;         // by stats_register handle
+    std::vector<uint32_t> gauge_levels;  // by stats_register_gauge handle, this cycle
+    std::vector<uint64_t> gauge_sums;    // of the levels since the last sample (-I)
+    std::vector<std::vector<uint64_t>> gauge_histograms; // cycles at each level, up to the capacity
+    int prediction = 0;
+    int correct = 0;
+    int total_btb_used = 0;
+    unsigned int instruction_count = 0;
+    unsigned int write_back_count = 0;
+    unsigned int load_store_count = 0;
+
+    EventStream pc_stream {"pc", 1, benchmark};
+    EventStream wb_stream {"wb", 2, benchmark};
+    EventStream ls_stream {"ls", 3, benchmark};
+
+    // Printing, dumping and checking of stream events. With stream_async
+    // the DPI hooks only enqueue a record and a dedicated thread does the
+    // work; a mismatch still sets `interrupt` for run().
+    struct StreamChecker
+    {
+        Simulation *sim;
+        SpscQueue<StreamEvent, 1 << 16> queue;
+        std::thread thread;
+        std::atomic<bool> stopping {false};
+
+        explicit StreamChecker(Simulation *sim) : sim(sim) {}
+
+        bool enabled() const { return stream_print || stream_dump || stream_check; }
+
+        void start()
+        {
+            stopping.store(false, std::memory_order_relaxed);
+            if (stream_async && enabled())
+                thread = std::thread(&StreamChecker::run, this);
+        }
+
+        // Drain every queued event and join the thread
+        void stop()
+        {
+            if (!thread.joinable())
+                return;
+            stopping.store(true, std::memory_order_release);
+            thread.join();
+        }
+
+        void push(uint32_t kind, uint32_t a, uint32_t b = 0, uint32_t c = 0)
+        {
+            if (!enabled())
+                return;
+            StreamEvent const ev {sim->main_time, kind, {a, b, c}};
+            if (!thread.joinable())
+            {
+                sim->handle_stream_event(ev);
+                return;
+            }
+            while (!queue.push(ev))
+                std::this_thread::yield();
+        }
+
+        void run()
+        {
+            StreamEvent ev;
+            unsigned idle = 0;
+            for (;;)
+            {
+                if (queue.pop(ev))
+                {
+                    sim->handle_stream_event(ev);
+                    idle = 0;
+                }
+                else if (stopping.load(std::memory_order_acquire))
+                {
+                    // The producer has stopped; anything left is already visible
+                    while (queue.pop(ev))
+                        sim->handle_stream_event(ev);
+                    return;
+                }
+                else if (++idle < 64)
+                    std::this_thread::yield();
+                else
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+    };
+
+    StreamChecker stream_checker {this};
+
+    // Co-simulation (-c)
+    Iss *iss = nullptr;
+    uint64_t cosim_checked = 0;
+    bool cosim_diverged = false;
+    uint32_t cosim_last_addr = 0;
+    bool cosim_access = false;               // ls_event of the instruction committing next
+    int cosim_access_op = 0;
+    uint32_t cosim_access_addr = 0, cosim_access_data = 0;
+
+    // Sampled simulation (-w / -N)
+    uint64_t commit_count = 0;
+    vluint64_t sample_start_time = 0;
+    vluint64_t sample_end_time = 0;
+
+    // Quiescence skipping (-q)
+    std::vector<int> cycle_stats;            // counters incremented this cycle
+    bool cycle_active = false;               // any other DPI event or AXI handshake
+#ifdef SIM_SAVABLE
+    ModelSnapshot quiet_snapshot;            // taken after each quiet cycle
+    std::vector<uint8_t> quiet_state;        // model state after the last quiet cycle
+#endif
+    unsigned quiet_compares = 0;
+    uint64_t skipped_cycles = 0;
+
+    // Time series (-I)
+    FILE *series = nullptr;
+    bool series_binary = false;
+    bool series_started = false;          // header written, columns fixed
+    size_t series_stats = 0, series_gauges = 0;
+    vluint64_t series_time = 0;           // of the last sample
+    uint64_t series_commits = 0;
+    uint64_t series_samples = 0;
+    std::vector<uint64_t> series_last;    // counters at the last sample
+
+    // Sweeps (-W / -X)
+    bool sweep_pc_reached = false;
+    int sweep_pipe = -1; // write end in a child, -1 otherwise
+    vluint64_t sweep_start_time = 0;
+    unsigned int sweep_start_instructions = 0;
+
+    Simulation(const std::string &benchmark, std::ostream &out, std::ostream &err)
+        : benchmark(benchmark), out(out), err(err) {}
+    ~Simulation();
+
+    void setup(int argc, char **argv);
+    void reload(const std::string &name);
+    void run();
+    void report();
+    void report_occupancy();
+    void report_host_profile();
+    RunResult result() const;
+
+    void load_program();
+    std::string find_memory_image() const;
+
+    void log_pipeline_stage(int stage, int a, int b, int c, int d, int e, int f);
+    void cosim_commit(uint32_t pc, bool writes, Register mips, uint32_t data);
+    void sample_commit();
+    void update_wave();
+    bool axi_handshake() const;
+#ifdef SIM_SAVABLE
+    void skip_quiescent();
+#endif
+
+    void handle_pc(const StreamEvent &ev);
+    void handle_wb(const StreamEvent &ev);
+    void handle_ls(const StreamEvent &ev);
+    void handle_stream_event(const StreamEvent &ev);
+
+    void save_harness(std::ostream &os);
+    bool restore_harness(std::istream &is);
+#ifdef SIM_SAVABLE
+    void save_checkpoint(const std::string &file_name);
+    void restore_checkpoint(const std::string &file_name);
+#endif
+
+    void open_series();
+    void sample_series();
+    void close_series();
+
+    bool at_sweep_point() const;
+    void run_sweep();
+};
+
+// The simulation evaluated on this thread. Models verilated with --threads
+// call the DPI from their own workers, which only a single run allows.
+thread_local Simulation *current = nullptr;
+Simulation *primary = nullptr;
+
+static Simulation &sim()
+{
+    return current ? *current : *primary;
+}
+
+double sc_time_stamp()
+{                           // Called by $time in Verilog
+    return sim().main_time; // converts to double, to match
+                            // what SystemC does
+}
+
+void signal_handler(int signal)
+{
+    sim().interrupt = signal;
+}
+
+void btb_event (int btb_hit){
+    Simulation &s = sim();
+    HostTimer timer(s.host, HOST_DPI);
+    s.cycle_active = true;
+    if(btb_hit==1){
+        s.total_btb_used++;
+    }
+}
+
+void predictor_event (int prediction, int correct){
+    Simulation &s = sim();
+    HostTimer timer(s.host, HOST_DPI);
+    s.cycle_active = true;
+    if(prediction==correct){
+        s.correct++;
+    }
+    s.prediction++;
+    //std::cout << "hi" << std::endl;
+}
+
+// *****************************************************
+// |   CO-SIMULATION (-c)                              |
+// *****************************************************
+// The ISS steps once per committed instruction and the architectural
+// effect of the commit (pc, destination register and value, and the
+// ls_event the core reports just before the commit) must match.
+void Simulation::cosim_commit(uint32_t pc, bool writes, Register mips, uint32_t data)
+{
+    bool const access = cosim_access;
+    cosim_access = false;
+    if (cosim_diverged)
+        return;
+
+    IssStep const expected = iss->step();
+    if (expected.load || expected.store)
+        cosim_last_addr = expected.addr;
+
+    bool const pc_ok = expected.pc == pc;
+    bool const rw_ok = writes == (expected.rw != 0)
+                    && (!writes || (mips == Register(expected.rw) && data == expected.value));
+    bool const ls_ok = access == (expected.load || expected.store)
+                    && (!access || (cosim_access_op == (expected.load ? LS_READ : LS_WRITE)
+                                    && (cosim_access_addr & Iss::ADDR_MASK) == expected.addr
+                                    && cosim_access_data == expected.data));
+    if (pc_ok && rw_ok && ls_ok)
+    {
+        cosim_checked++;
+        return;
+    }
+
+    cosim_diverged = true;
+    out << "\n!! [" << std::dec << main_time << "] Co-simulation diverged after "
+        << cosim_checked << " instructions"
+        << "\n!! expected pc=" << std::hex << expected.pc << " " << to_string(expected.ins);
+    if (expected.rw)
+        out << " " << to_string(Register(expected.rw)) << "=" << expected.value;
+    if (expected.load || expected.store)
+        out << " " << (expected.load ? "load" : "store") << " [" << expected.addr << "]=" << expected.data;
+    out << "\n!!   commit pc=" << pc;
+    if (writes)
+        out << " " << to_string(mips) << "=" << data;
+    if (access)
+        out << " " << (cosim_access_op == LS_READ ? "load" : "store")
+            << " [" << cosim_access_addr << "]=" << cosim_access_data;
+    out << "\n!! ISS registers (after the expected instruction):\n";
+    iss->dump_registers(out);
+    out << "!! ISS memory around the last access:\n";
+    iss->dump_memory(out, cosim_last_addr);
+    out << std::dec << std::flush;
+    interrupt = SIGINT;
+}
+
+// Reset state of fetch_unit and physical_registers, taken from the ISS
+// once it has fast-forwarded
+int initial_pc()
+{
+    return fast_forward ? sim().iss->pc : 0;
+}
+
+int initial_register(int index)
+{
+    return fast_forward ? sim().iss->regs[index] : 0;
+}
+
+// *****************************************************
+// |   SAMPLED SIMULATION (-w / -N)                    |
+// *****************************************************
+// Detailed simulation of one interval: the first sample_warmup commits
+// warm up caches and predictors, the next sample_length are measured.
+void Simulation::sample_commit()
+{
+    commit_count++;
+    if (commit_count == sample_warmup)
+        sample_start_time = main_time;
+    else if (sample_length && commit_count == sample_warmup + sample_length)
+        sample_end_time = main_time;
+}
+
+void log_pipeline_stage(int stage,
+    int a, int b, int c, int d, int e, int f
+) {
+    Simulation &s = sim();
+    HostTimer timer(s.host, HOST_DPI);
+    s.log_pipeline_stage(stage, a, b, c, d, e, f);
+}
+
+void Simulation::log_pipeline_stage(int stage,
+    int a, int b, int c, int d, int e, int f
+) {
+    // Only an event the harness records makes the cycle active: fetch and
+    // decode repeat every cycle the frontend is stalled
+    if (stage == 4 || tracer.is_open() || kanata.is_open() || latency_profile
+        || (pc_profile && stage == PIPELINE_FLUSH_STAGE))
+        cycle_active = true;
+    if (stage == 4)
+    {
+        sample_commit();
+        if (sweep_pc >= 0 && uint32_t(a) == uint32_t(sweep_pc))
+            sweep_pc_reached = true;
+        if ((wave_spec.pc >= 0 && uint32_t(a) == uint32_t(wave_spec.pc)) || commit_count == wave_spec.commit)
+            wave_triggered = true;
+        if (cosim)
+            cosim_commit(a, c & 1, Register(f), e);
+    }
+
+    if (pc_profile && stage == PIPELINE_FLUSH_STAGE)
+        profile.flush(a);
+
+    int const fields[] = { a, b, c, d, e, f };
+    if (tracer.is_open())
+        tracer.record(main_time, stage, fields);
+    if (kanata.is_open())
+        kanata.record(CYCLES(main_time), stage, fields);
+    if (latency_profile)
+        latency.record(CYCLES(main_time), stage, fields);
+}
+
+// *****************************************************
+// |   STATS COUNTERS                                  |
+// *****************************************************
+// The core registers each counter by name once (from an initial block) and
+// counts through the handle. Handles are shared by every model in the
+// process, so the same name has the same handle in all of them.
+// Gauges work the same way for levels, e.g. the occupancy of a queue,
+// which the core reports every cycle.
+struct StatGauge
+{
+    std::string name;
+    unsigned capacity;
+};
+
+std::mutex stat_names_mutex;
+std::vector<std::string> stat_names; // by handle
+std::vector<StatGauge> stat_gauges;  // by handle
+
+int stats_register(const char *name)
+{
+    std::lock_guard<std::mutex> lock(stat_names_mutex);
+    auto const it = std::find(stat_names.begin(), stat_names.end(), name);
+    if (it != stat_names.end())
+        return int(it - stat_names.begin());
+    stat_names.push_back(name);
+    return int(stat_names.size() - 1);
+}
+
+// The handle of a registered counter or gauge, -1 if there is none
+int stats_find(const char *name)
+{
+    std::lock_guard<std::mutex> lock(stat_names_mutex);
+    auto const it = std::find(stat_names.begin(), stat_names.end(), name);
+    return it != stat_names.end() ? int(it - stat_names.begin()) : -1;
+}
+
+void stats_increment(int handle)
+{
+    Simulation &sim = ::sim();
+    HostTimer timer(sim.host, HOST_DPI);
+    if (unsigned(handle) >= sim.stats.size())
+        sim.stats.resize(handle + 1);
+    sim.stats[handle]++;
+    if (quiesce)
+        sim.cycle_stats.push_back(handle);
+    if (handle == wave_spec.stat)
+        sim.wave_triggered = true;
+}
+
+int stats_register_gauge(const char *name, int capacity)
+{
+    std::lock_guard<std::mutex> lock(stat_names_mutex);
+    for (size_t i = 0; i < stat_gauges.size(); i++)
+    {
+        if (stat_gauges[i].name == name)
+            return int(i);
+    }
+    stat_gauges.push_back({name, unsigned(capacity)});
+    return int(stat_gauges.size() - 1);
+}
+
+void stats_gauge(int handle, int level)
+{
+    Simulation &sim = ::sim();
+    HostTimer timer(sim.host, HOST_DPI);
+    if (unsigned(handle) >= sim.gauge_levels.size())
+    {
+        sim.gauge_levels.resize(handle + 1);
+        sim.gauge_sums.resize(handle + 1);
+        sim.gauge_histograms.resize(handle + 1);
+    }
+    std::vector<uint64_t> &histogram = sim.gauge_histograms[handle];
+    if (histogram.empty())
+    {
+        std::lock_guard<std::mutex> lock(stat_names_mutex);
+        histogram.resize(stat_gauges[handle].capacity + 1);
+    }
+    sim.gauge_levels[handle] = level;
+    sim.gauge_sums[handle] += level;
+    histogram[std::min<size_t>(level, histogram.size() - 1)]++;
+}
+
+// *****************************************************
+// |   TIME SERIES (-I)                                |
+// *****************************************************
+// Every -I cycles one row: the cycle, instructions committed, IPC and
+// branch MPKI over the interval, how much each counter grew and the mean
+// level of each gauge. Counters and gauges are those registered by the
+// first sample. A file named *.bin gets the raw values instead: "MSER",
+// the column count and the NUL-terminated column names, then one row of
+// uint64_t per sample (cycle, instructions, each counter's increase and
+// each gauge's sum of levels over the interval's cycles).
+#define SERIES_MAGIC 0x5245534d // "MSER"
+
+void Simulation::open_series()
+{
+    close_series();
+    if (!series_interval)
+        return;
+    std::string const name = series_file ? series_file : benchmark + ".series.csv";
+    series_binary = name.size() > 4 && name.compare(name.size() - 4, 4, ".bin") == 0;
+    series = fopen(name.c_str(), series_binary ? "wb" : "w");
+    if (series == NULL)
+    {
+        std::cerr << "Failed to open file: " << name << std::endl;
+        exit(-1);
+    }
+    series_started = false;
+    series_time = 0;
+    series_commits = 0;
+    series_samples = 0;
+}
+
+void Simulation::sample_series()
+{
+    if (!series_started)
+    {
+        std::lock_guard<std::mutex> lock(stat_names_mutex);
+        series_stats = stat_names.size();
+        series_gauges = stat_gauges.size();
+        std::vector<std::string> columns {"cycle", "instructions"};
+        if (!series_binary)
+            columns.insert(columns.end(), {"ipc", "br_mpki"});
+        columns.insert(columns.end(), stat_names.begin(), stat_names.end());
+        for (const StatGauge &gauge : stat_gauges)
+            columns.push_back(gauge.name);
+
+        if (series_binary)
+        {
+            uint32_t const header[2] = {SERIES_MAGIC, uint32_t(columns.size())};
+            fwrite(header, sizeof(header), 1, series);
+            for (const std::string &column : columns)
+                fwrite(column.c_str(), column.size() + 1, 1, series);
+        }
+        else
+        {
+            for (size_t i = 0; i < columns.size(); i++)
+                fprintf(series, "%s%s", i ? "," : "", columns[i].c_str());
+            fprintf(series, "\n");
+        }
+        series_last.assign(series_stats, 0);
+        series_started = true;
+    }
+
+    uint64_t const cycles = CYCLES(main_time - series_time);
+    uint64_t const instructions = commit_count - series_commits;
+    auto const stat = [this](size_t handle) { return handle < stats.size() ? stats[handle] : 0; };
+    auto const gauge = [this](size_t handle) { return handle < gauge_sums.size() ? gauge_sums[handle] : 0; };
+
+    if (series_binary)
+    {
+        std::vector<uint64_t> row {CYCLES(main_time), instructions};
+        for (size_t i = 0; i < series_stats; i++)
+            row.push_back(stat(i) - series_last[i]);
+        for (size_t i = 0; i < series_gauges; i++)
+            row.push_back(gauge(i));
+        fwrite(row.data(), sizeof(uint64_t), row.size(), series);
+    }
+    else
+    {
+        unsigned const br_miss = stats_find("br_miss");
+        uint64_t const branch_misses = br_miss < series_stats ? stat(br_miss) - series_last[br_miss] : 0;
+        fprintf(series, "%" PRIu64 ",%" PRIu64 ",%.4f,%.3f", uint64_t(CYCLES(main_time)), instructions,
+            cycles ? double(instructions) / cycles : 0.0,
+            instructions ? 1000.0 * branch_misses / instructions : 0.0);
+        for (size_t i = 0; i < series_stats; i++)
+            fprintf(series, ",%" PRIu64, stat(i) - series_last[i]);
+        for (size_t i = 0; i < series_gauges; i++)
+            fprintf(series, ",%.2f", cycles ? double(gauge(i)) / cycles : 0.0);
+        fprintf(series, "\n");
+    }
+
+    for (size_t i = 0; i < series_stats; i++)
+        series_last[i] = stat(i);
+    std::fill(gauge_sums.begin(), gauge_sums.end(), 0);
+    series_time = main_time;
+    series_commits = commit_count;
+    series_samples++;
+}
+
+// The last row covers what is left of the run
+void Simulation::close_series()
+{
+    if (series == nullptr)
+        return;
+    if (main_time > series_time)
+        sample_series();
+    fclose(series);
+    series = nullptr;
+    out << "Wrote " << series_samples << " samples of " << series_interval << " cycles to \""
+        << (series_file ? series_file : benchmark + ".series.csv") << "\"" << std::endl;
+}
+
+// Every cycle out of reset, the head of the commit queue (-A)
+void commit_head_event(int pc, int state)
+{
+    if (!pc_profile)
+        return;
+    Simulation &s = sim();
+    HostTimer timer(s.host, HOST_DPI);
+    s.profile.head(pc, state);
+}
+
+void Simulation::handle_pc(const StreamEvent &ev)
+{
+    unsigned int const pc = ev.fields[0];
+    if (stream_print)
+        out << "-- EVENT pc=" << std::hex << pc << std::endl;
+    if (stream_dump)
+        pc_stream.record(ev.time, ev.fields);
+    if (stream_check)
+    {
+        uint32_t expected[1];
+        if (!pc_stream.expect(expected))
+        {
+            out << "\n!! Ran out of expected pc."
+                   "\n!! More instructions are executed than expected"
+                   "\n!! Additional pc="
+                << std::hex << pc << std::endl;
+            interrupt = SIGINT;
+        }
+        else if (expected[0] != pc)
+        {
+            out << "\n!! [" << std::dec << ev.time << "] expected_pc=" << std::hex << expected[0]
+                << " mismatches pc=" << pc << std::endl;
+            interrupt = SIGINT;
+        }
+    }
+}
+
+void Simulation::handle_wb(const StreamEvent &ev)
+{
+    unsigned int const addr = ev.fields[0], data = ev.fields[1];
+    if (stream_print)
+        out << "-- EVENT wb addr=" << std::hex << addr
+            << " data=" << data << std::endl;
+    if (stream_dump)
+        wb_stream.record(ev.time, ev.fields);
+    if (stream_check)
+    {
+        uint32_t expected[2];
+        if (!wb_stream.expect(expected))
+        {
+            out << "\n!! Ran out of expected write back."
+                   "\n!! More write back are executed than expected"
+                   "\n!! Additional write back addr="
+                << std::hex << addr << " data=" << data << std::endl;
+            interrupt = SIGINT;
+        }
+        else if (expected[0] != addr || expected[1] != data)
+        {
+            out << "\n!! [" << std::dec << ev.time << "] expected write back mismatches"
+                << "\n!! [" << std::dec << ev.time << "] expected addr=" << std::hex << expected[0]
+                << " data=" << expected[1]
+                << "\n!! [" << std::dec << ev.time << "] actual   addr=" << std::hex << addr
+                << " data=" << data << std::endl;
+            interrupt = SIGINT;
+        }
+    }
+}
+
+void Simulation::handle_ls(const StreamEvent &ev)
+{
+    unsigned int const op = ev.fields[0], addr = ev.fields[1], data = ev.fields[2];
+    if (stream_print)
+        out << "-- EVENT ls op=" << std::hex << op
+            << " addr=" << addr
+            << " data=" << data << std::endl;
+    if (stream_dump)
+        ls_stream.record(ev.time, ev.fields);
+    if (stream_check)
+    {
+        uint32_t expected[3];
+        if (!ls_stream.expect(expected))
+        {
+            out << "\n!! Ran out of expected load store"
+                   "\n!! More load store are executed than expected"
+                   "\n!! Additional load store op="
+                << std::hex << op << " addr=" << addr << " data=" << data << std::endl;
+            interrupt = SIGINT;
+        }
+        else if (expected[0] != op || expected[1] != addr || expected[2] != data)
+        {
+            out << "\n!! [" << std::dec << ev.time << "] expected load store mismatches"
+                << "\n!! [" << std::dec << ev.time << "] expected op=" << std::hex << expected[0]
+                << " addr=" << expected[1]
+                << " data=" << expected[2]
+                << "\n!! [" << std::dec << ev.time << "] actual   op=" << std::hex << op
+                << " addr=" << addr
+                << " data=" << data << std::endl;
+            interrupt = SIGINT;
+        }
+    }
+}
+
+void Simulation::handle_stream_event(const StreamEvent &ev)
+{
+    HostTimer timer(host, HOST_STREAMS);
+    switch (ev.kind)
+    {
+    case STREAM_PC: handle_pc(ev); break;
+    case STREAM_WB: handle_wb(ev); break;
+    case STREAM_LS: handle_ls(ev); break;
+    }
+}
+
+void pc_event(const int pc)
+{
+    Simulation &s = sim();
+    HostTimer timer(s.host, HOST_DPI);
+    s.cycle_active = true;
+    s.stream_checker.push(STREAM_PC, pc);
+    s.instruction_count++;
+}
+
+void wb_event(const int addr, const int data)
+{
+    Simulation &s = sim();
+    HostTimer timer(s.host, HOST_DPI);
+    s.cycle_active = true;
+    s.stream_checker.push(STREAM_WB, addr, data);
+    s.write_back_count++;
+}
+
+void ls_event(const int op, const int addr, const int data)
+{
+    Simulation &s = sim();
+    HostTimer timer(s.host, HOST_DPI);
+    s.cycle_active = true;
+    s.stream_checker.push(STREAM_LS, op, addr, data);
+    s.load_store_count++;
+    if (cosim)
+    {
+        s.cosim_access = true;
+        s.cosim_access_op = op;
+        s.cosim_access_addr = addr;
+        s.cosim_access_data = data;
+    }
+}
+
+void Simulation::save_harness(std::ostream &os)
+{
+    checkpoint_put(os, uint32_t(CHECKPOINT_MAGIC));
+    checkpoint_put(os, uint32_t(CHECKPOINT_VERSION));
+    checkpoint_put(os, benchmark);
+    checkpoint_put(os, main_time);
+
+    checkpoint_put(os, prediction);
+    checkpoint_put(os, correct);
+    checkpoint_put(os, total_btb_used);
+    checkpoint_put(os, instruction_count);
+    checkpoint_put(os, write_back_count);
+    checkpoint_put(os, load_store_count);
+    checkpoint_put(os, commit_count);
+    checkpoint_put(os, cosim_checked);
+
+    // By name, as handles depend on the order of registration. Every
+    // registered counter, also those not counted yet: the model keeps
+    // their handles.
+    std::lock_guard<std::mutex> lock(stat_names_mutex);
+    checkpoint_put(os, uint32_t(stat_names.size()));
+    for (size_t i = 0; i < stat_names.size(); i++)
+    {
+        checkpoint_put(os, stat_names[i]);
+        checkpoint_put(os, i < stats.size() ? stats[i] : uint64_t(0));
+    }
+    checkpoint_put(os, uint32_t(stat_gauges.size()));
+    for (size_t i = 0; i < stat_gauges.size(); i++)
+    {
+        bool const seen = i < gauge_levels.size();
+        checkpoint_put(os, stat_gauges[i].name);
+        checkpoint_put(os, stat_gauges[i].capacity);
+        checkpoint_put(os, seen ? gauge_levels[i] : uint32_t(0));
+        checkpoint_put(os, seen ? gauge_sums[i] : uint64_t(0));
+        checkpoint_put(os, uint32_t(seen ? gauge_histograms[i].size() : 0));
+        if (seen)
+        {
+            for (uint64_t cycles : gauge_histograms[i])
+                checkpoint_put(os, cycles);
+        }
+    }
+
+    for (EventStream *stream : {&pc_stream, &wb_stream, &ls_stream})
+        checkpoint_put(os, stream->golden.position());
+
+    checkpoint_put(os, iss != nullptr);
+    if (iss)
+        iss->save(os);
+    memory->save(os);
+}
+
+bool Simulation::restore_harness(std::istream &is)
+{
+    uint32_t magic = 0, version = 0;
+    std::string saved_benchmark;
+    checkpoint_get(is, magic);
+    checkpoint_get(is, version);
+    if (magic != CHECKPOINT_MAGIC || version != CHECKPOINT_VERSION)
+    {
+        std::cerr << "Not a checkpoint of this simulator version" << std::endl;
+        return false;
+    }
+    if (!checkpoint_get(is, saved_benchmark) || saved_benchmark != benchmark)
+    {
+        std::cerr << "Checkpoint is of benchmark " << saved_benchmark << ", not " << benchmark << std::endl;
+        return false;
+    }
+
+    uint32_t stat_count = 0;
+    bool ok = checkpoint_get(is, main_time)
+           && checkpoint_get(is, prediction)
+           && checkpoint_get(is, correct)
+           && checkpoint_get(is, total_btb_used)
+           && checkpoint_get(is, instruction_count)
+           && checkpoint_get(is, write_back_count)
+           && checkpoint_get(is, load_store_count)
+           && checkpoint_get(is, commit_count)
+           && checkpoint_get(is, cosim_checked)
+           && checkpoint_get(is, stat_count);
+
+    stats.clear();
+    for (uint32_t i = 0; ok && i < stat_count; i++)
+    {
+        std::string name;
+        uint64_t count = 0;
+        ok = checkpoint_get(is, name) && checkpoint_get(is, count);
+        if (!ok)
+            break;
+        // The restored model counts by the saved handles
+        if (stats_register(name.c_str()) != int(i))
+        {
+            std::cerr << "Checkpoint counter " << name << " has another handle in this process" << std::endl;
+            return false;
+        }
+        if (i >= stats.size())
+            stats.resize(i + 1);
+        stats[i] = count;
+    }
+
+    uint32_t gauge_count = 0;
+    ok = ok && checkpoint_get(is, gauge_count);
+    gauge_levels.assign(gauge_count, 0);
+    gauge_sums.assign(gauge_count, 0);
+    gauge_histograms.assign(gauge_count, {});
+    for (uint32_t i = 0; ok && i < gauge_count; i++)
+    {
+        std::string name;
+        unsigned capacity = 0;
+        uint32_t levels = 0;
+        ok = checkpoint_get(is, name) && checkpoint_get(is, capacity) && checkpoint_get(is, gauge_levels[i])
+          && checkpoint_get(is, gauge_sums[i]) && checkpoint_get(is, levels);
+        if (!ok)
+            break;
+        if (stats_register_gauge(name.c_str(), capacity) != int(i))
+        {
+            std::cerr << "Checkpoint gauge " << name << " has another handle in this process" << std::endl;
+            return false;
+        }
+        gauge_histograms[i].resize(levels);
+        for (uint64_t &cycles : gauge_histograms[i])
+            ok = ok && checkpoint_get(is, cycles);
+    }
+
+    for (EventStream *stream : {&pc_stream, &wb_stream, &ls_stream})
+    {
+        uint64_t position = 0;
+        ok = ok && checkpoint_get(is, position);
+        if (ok && stream_check && position > 0)
+            stream->seek(position);
+    }
+
+    bool has_iss = false;
+    ok = ok && checkpoint_get(is, has_iss);
+    if (ok && has_iss)
+    {
+        if (!iss)
+            iss = new Iss;
+        ok = iss->restore(is);
+    }
+    else if (ok && cosim)
+    {
+        std::cerr << "Checkpoint has no ISS state for -c, take it with -c" << std::endl;
+        return false;
+    }
+    return ok && memory->restore(is);
+}
+
+#ifdef SIM_SAVABLE
+void Simulation::save_checkpoint(const std::string &file_name)
+{
+    stream_checker.stop(); // settle the golden trace positions
+
+    std::ostringstream harness;
+    save_harness(harness);
+    std::string const blob = harness.str();
+    uint64_t const size = blob.size();
+
+    VerilatedSave os;
+    os.open(file_name);
+    if (!os.isOpen())
+    {
+        std::cerr << "Failed to open file: " << file_name << std::endl;
+        exit(-1);
+    }
+    os.write(&size, sizeof(size));
+    os.write(blob.data(), size);
+    os << *top;
+    os.close();
+
+    stream_checker.start();
+    out << "Checkpoint at cycle " << CYCLES(main_time) << " saved to " << file_name << std::endl;
+}
+
+void Simulation::restore_checkpoint(const std::string &file_name)
+{
+    VerilatedRestore is;
+    is.open(file_name);
+    if (!is.isOpen())
+    {
+        std::cerr << "Failed to open file: " << file_name << std::endl;
+        exit(-1);
+    }
+    uint64_t size = 0;
+    is.read(&size, sizeof(size));
+    std::string blob(size, '\0');
+    is.read(&blob[0], size);
+    std::istringstream harness(blob);
+    if (!restore_harness(harness))
+    {
+        std::cerr << "Failed to restore checkpoint: " << file_name << std::endl;
+        exit(-1);
+    }
+    is >> *top;
+    is.close();
+    out << "Restored checkpoint " << file_name << " at cycle " << CYCLES(main_time) << std::endl;
+}
+#endif
+
+// <FACTOR>[/<READS>/<WRITES>],... e.g. "0.5,1,2,4/2/2"
+bool parse_sweep_configs(const char *spec)
+{
+    std::stringstream list(spec);
+    std::string item;
+    while (std::getline(list, item, ','))
+    {
+        SweepConfig config {1.0, AXI_READ_ADDR_MAX_PENDING, AXI_WRITE_ADDR_MAX_PENDING};
+        char slash;
+        std::stringstream fields(item);
+        if (!(fields >> config.delay_factor))
+            return false;
+        if (fields >> slash && !(slash == '/' && fields >> config.read_limit >> slash >> config.write_limit))
+            return false;
+        if (config.read_limit == 0 || config.write_limit == 0)
+            return false;
+        sweep_configs.push_back(config);
+    }
+    return !sweep_configs.empty();
+}
+
+// <CYCLE> or pc:<PC> (the first commit of that pc)
+bool parse_sweep_point(const char *spec)
+{
+    std::string const point(spec);
+    if (point.compare(0, 3, "pc:") == 0)
+        sweep_pc = std::stoll(point.substr(3), nullptr, 16);
+    else
+        sweep_cycle = std::stoull(point);
+    return sweep_pc >= 0 || sweep_cycle > 0;
+}
+
+// Comma separated cycles:<FROM>[-<TO>], pc:<PC>, commit:<N>, stat:<NAME>,
+// mismatch, length:<CYCLES>, scope:<NAME> and depth:<LEVELS>
+bool parse_wave_spec(const char *spec)
+{
+    std::stringstream list(spec);
+    std::string item;
+    while (std::getline(list, item, ','))
+    {
+        size_t const colon = item.find(':');
+        std::string const key = item.substr(0, colon);
+        std::string const value = colon == std::string::npos ? "" : item.substr(colon + 1);
+        try
+        {
+            if (key == "cycles")
+            {
+                size_t const dash = value.find('-');
+                wave_spec.from = std::stoull(value.substr(0, dash));
+                if (dash != std::string::npos)
+                    wave_spec.to = std::stoull(value.substr(dash + 1));
+                if (wave_spec.from == 0)
+                    wave_spec.from = 1; // 0 would not start the window
+            }
+            else if (key == "pc")
+                wave_spec.pc = std::stoll(value, nullptr, 16);
+            else if (key == "commit")
+                wave_spec.commit = std::stoull(value);
+            else if (key == "stat" && !value.empty())
+                wave_spec.stat_name = value;
+            else if (key == "mismatch" && value.empty())
+                wave_spec.mismatch = true;
+            else if (key == "length")
+                wave_spec.length = std::stoull(value);
+            else if (key == "scope" && !value.empty())
+                wave_spec.scope = value;
+            else if (key == "depth")
+                wave_spec.depth = std::stoi(value);
+            else
+                return false;
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+    }
+    return !wave_spec.to || wave_spec.to > wave_spec.from;
+}
+
+// stat:<NAME> is checked once the model has registered its counters
+void resolve_wave_stat()
+{
+    wave_spec.stat = stats_find(wave_spec.stat_name.c_str());
+    if (wave_spec.stat < 0)
+    {
+        std::cerr << "-D: unknown stat: " << wave_spec.stat_name << std::endl;
+        exit(-1);
+    }
+}
+
+bool Simulation::at_sweep_point() const
+{
+    if (sweep_configs.empty() || sweep_pipe >= 0)
+        return false;
+    return sweep_pc >= 0 ? sweep_pc_reached : main_time == sweep_cycle * 10;
+}
+
+// Returns only in a child, with its configuration applied
+void Simulation::run_sweep()
+{
+    stream_checker.stop(); // no threads across fork()
+    std::cout << std::flush;
+    std::cerr << std::flush;
+    if (series)
+        fflush(series);
+
+    std::vector<pid_t> children;
+    std::vector<int> results;
+    for (const SweepConfig &config : sweep_configs)
+    {
+        int fd[2];
+        if (pipe(fd) != 0)
+        {
+            perror("pipe");
+            exit(-1);
+        }
+        pid_t const pid = fork();
+        if (pid < 0)
+        {
+            perror("fork");
+            exit(-1);
+        }
+        if (pid == 0)
+        {
+            for (int other : results)
+                close(other);
+            close(fd[0]);
+            sweep_pipe = fd[1];
+            series = nullptr; // the parent's; the series ends at the sweep point
+            sweep_start_time = main_time;
+            sweep_start_instructions = instruction_count;
+            memory->set_delay_factor(config.delay_factor);
+            memory->set_pending_limits(config.read_limit, config.write_limit);
+            stream_checker.start();
+            return;
+        }
+        close(fd[1]);
+        children.push_back(pid);
+        results.push_back(fd[0]);
+    }
+
+    std::cout << "\n== Sweep from cycle " << CYCLES(main_time) << " ==\n";
+    printf("%12s %10s %11s %12s %20s %13s %13s\n",
+        "Delay factor", "Read limit", "Write limit", "Cycle count", "Instruction count", "CPI", "IPC");
+    for (size_t i = 0; i < children.size(); i++)
+    {
+        SweepResult r {};
+        bool const ok = read(results[i], &r, sizeof(r)) == sizeof(r);
+        close(results[i]);
+        waitpid(children[i], NULL, 0);
+
+        const SweepConfig &config = sweep_configs[i];
+        if (!ok || r.aborted)
+        {
+            printf("%12g %10u %11u %12s\n", config.delay_factor, config.read_limit, config.write_limit,
+                   ok ? "aborted" : "failed");
+            continue;
+        }
+        printf("%12g %10u %11u %12lu %20lu %13f %13f\n",
+            config.delay_factor, config.read_limit, config.write_limit,
+            (unsigned long)r.cycles, (unsigned long)r.instructions,
+            (double)r.cycles / r.instructions, (double)r.instructions / r.cycles);
+    }
+    exit(0);
+}
+
+// *****************************************************
+// |   QUIESCENCE SKIPPING (-q)                        |
+// *****************************************************
+// While the core waits on memory it often repeats the same cycle: no AXI
+// handshake, no DPI event but the stall counters, and no state change. The
+// cycles up to the memory's next event are then identical, so they are
+// skipped and the counts of the last one repeated.
+//
+// A cycle is a function of the model state and its inputs. Until the
+// memory's next event the inputs hold still, so a cycle that leaves the
+// state as it found it would repeat until then. The state is what the
+// model itself serializes for a checkpoint, which is everything a restore
+// needs to continue, hence a model verilated with --savable. Events that
+// the harness records (a commit, a trace) make a cycle active and are
+// never skipped; counters, gauges and the commit head are repeated.
+#define QUIET_MAX_COMPARES 4 // changing cycles tolerated per quiet stretch
+
+bool Simulation::axi_handshake() const
+{
+    return (top->AWVALID && top->AWREADY) || (top->WVALID && top->WREADY)
+        || (top->BVALID && top->BREADY) || (top->ARVALID && top->ARREADY)
+        || (top->RVALID && top->RREADY);
+}
+
+#ifdef SIM_SAVABLE
+// Called at the end of each cycle, with main_time at the next posedge
+void Simulation::skip_quiescent()
+{
+    uint64_t const next = memory->next_event_time();
+    if (cycle_active || next <= main_time)
+    {
+        quiet_state.clear();
+        quiet_compares = 0;
+        return;
+    }
+    if (quiet_compares >= QUIET_MAX_COMPARES)
+        return; // some state keeps changing (a counter), wait for activity
+
+    quiet_snapshot.take(*top);
+    if (quiet_state.empty() || quiet_state != quiet_snapshot.data)
+    {
+        if (!quiet_state.empty())
+            quiet_compares++;
+        quiet_state.swap(quiet_snapshot.data);
+        return;
+    }
+    if (next == UINT64_MAX)
+        return; // nothing will ever wake the core up; let it run into the hang
+
+    // Resume at the posedge that sees the memory event, or at a cycle the
+    // harness acts on
+    uint64_t target = (next + 9) / 10 * 10;
+    if (checkpoint_cycle && checkpoint_cycle * 10 > main_time)
+        target = std::min<uint64_t>(target, checkpoint_cycle * 10);
+    if (!sweep_configs.empty() && sweep_pc < 0 && sweep_cycle * 10 > main_time)
+        target = std::min<uint64_t>(target, sweep_cycle * 10);
+    if (tfp && wave_spec.from * 10 > main_time)
+        target = std::min<uint64_t>(target, wave_spec.from * 10);
+    if (series)
+        target = std::min<uint64_t>(target, series_time + series_interval * 10);
+    if (target <= main_time)
+        return;
+
+    uint64_t const cycles = CYCLES(target - main_time);
+    for (int handle : cycle_stats)
+        stats[handle] += cycles;
+    for (size_t i = 0; i < gauge_levels.size(); i++)
+    {
+        gauge_sums[i] += uint64_t(gauge_levels[i]) * cycles;
+        std::vector<uint64_t> &histogram = gauge_histograms[i];
+        if (!histogram.empty())
+            histogram[std::min<size_t>(gauge_levels[i], histogram.size() - 1)] += cycles;
+    }
+    if (pc_profile)
+        profile.repeat(cycles);
+    skipped_cycles += cycles;
+    main_time = target;
+}
+#endif
+
+// Prefer the ELF, then a raw binary image, then the text hex dump
+std::string Simulation::find_memory_image() const
+{
+    std::string const base(hexfiles_dir + "/hexfiles/" + benchmark);
+    for (auto ext : {".out", ".bin"})
+    {
+        if (access((base + ext).c_str(), R_OK) == 0)
+            return base + ext;
+    }
+    return base + ".hex";
+}
+
+// Build the model and load the program
+void Simulation::setup(int argc, char **argv)
+{
+    if (output_trace && !tracer.open(output_trace, benchmark, trace_filter))
+        exit(-1);
+    if (kanata_file && !kanata.open(kanata_file))
+        exit(-1);
+    open_series();
+    contextp = new VerilatedContext;
+    contextp->commandArgs(argc, argv); // Remember args
+    if (sim_threads > 0)
+        contextp->threads(sim_threads); // must precede model creation
+
+    if (wave_dump)
+        contextp->traceEverOn(true); // before the model is built
+
+    top = new Vmips_core(contextp); // Create instance
+    load_program();
+    memory_driver = new MemoryDriver(top, memory);
 
-double sc_time_stamp()
-{                     // Called by $time in Verilog
-    return main_time; // converts to double, to match
-                      // what SystemC does
+    if (wave_dump)
+    {
+        // Registered up front, opened by update_wave()
+        tfp = new VerilatedFstC;
+        if (!wave_spec.scope.empty())
+            tfp->dumpvars(wave_spec.depth, wave_spec.scope);
+        top->trace(tfp, wave_spec.depth);
+    }
 }
 
-volatile std::sig_atomic_t interrupt = 0;
-vluint64_t stop_time = 0;
+// Open simx.fst when the -D window starts and close it when it ends
+void Simulation::update_wave()
+{
+    if (wave_done)
+        return;
+    if (!tfp->isOpen())
+    {
+        bool const start = !wave_spec.triggered() || wave_triggered
+                        || (wave_spec.from && main_time >= wave_spec.from * 10)
+                        || (wave_spec.mismatch && interrupt);
+        if (!start)
+            return;
+        out << "Dumping waveform to simx.fst from cycle " << CYCLES(main_time) << std::endl;
+        tfp->open("simx.fst");
+        if (wave_spec.to)
+            wave_end_time = wave_spec.to * 10;
+        if (wave_spec.length && (!wave_end_time || main_time + wave_spec.length * 10 < wave_end_time))
+            wave_end_time = main_time + wave_spec.length * 10;
+    }
+    else if (wave_end_time && main_time >= wave_end_time)
+    {
+        tfp->close();
+        wave_done = true;
+        out << "Waveform closed at cycle " << CYCLES(main_time) << std::endl;
+    }
+}
 
-void signal_handler(int signal)
+// Memory image and, for -c and -F, the ISS
+void Simulation::load_program()
 {
-    interrupt = signal;
+    std::string const image_file_name = memory_image ? memory_image : find_memory_image();
+    if (!memory)
+        memory = new Memory(image_file_name.c_str(), memory_delay_factor);
+    else if (!memory->reload(image_file_name.c_str()))
+        exit(-1);
+
+    delete iss;
+    iss = nullptr;
+    if (cosim || fast_forward)
+    {
+        iss = new Iss;
+        if (!iss->load(image_file_name.c_str()))
+        {
+            std::cerr << "Failed to load image for the ISS: " << image_file_name << std::endl;
+            exit(-1);
+        }
+    }
+    if (fast_forward)
+    {
+        // Reset loads the ISS registers and pc (initial_register/initial_pc),
+        // memory gets its image. Caches start cold, so nothing else is stale.
+        auto const ff_start = std::chrono::steady_clock::now();
+        uint64_t const skipped = iss->run(fast_forward);
+        double const ff_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - ff_start).count();
+        if (iss->done)
+        {
+            std::cerr << benchmark << ": program finished after " << skipped << " instructions, "
+                      << "nothing left to simulate after fast-forwarding " << fast_forward << std::endl;
+            exit(-1);
+        }
+        memory->store().assign(iss->mem);
+        out << "Fast-forwarded " << skipped << " instructions in " << ff_seconds << " s ("
+            << std::fixed << std::setprecision(1) << skipped / ff_seconds / 1e6 << std::defaultfloat
+            << " MIPS), resuming at pc=" << std::hex << iss->pc << std::dec << std::endl;
+    }
+    if (pc_profile)
+        profile.reset(&memory->store());
+    if (latency_profile)
+        latency.reset(&memory->store());
 }
 
-std::unordered_map<std::string, unsigned int> stats;
+// Start another program on the same model. The harness forgets the last
+// run and run() holds the core in reset for the first 10 cycles, as after
+// construction; only arrays the RTL never resets (cache tags and data
+// behind cleared valid bits) keep stale contents.
+void Simulation::reload(const std::string &name)
+{
+    benchmark = name;
+    for (EventStream *stream : {&pc_stream, &wb_stream, &ls_stream})
+    {
+        stream->close();
+        stream->benchmark = name;
+    }
 
-#define T(X) (X*100)
-#define DURATION 1000   // default duration
-#define S_DURATION "1000" // default duration
-#define CYCLES(TIME) (TIME/10) // time to Cycle count
+    main_time = 0;
+    stop_time = 0;
+    interrupt = 0;
+    host_seconds = 0;
+    host = HostProfile();
+    stats.clear();
+    std::fill(gauge_sums.begin(), gauge_sums.end(), 0);
+    for (std::vector<uint64_t> &histogram : gauge_histograms)
+        std::fill(histogram.begin(), histogram.end(), 0);
+    prediction = correct = total_btb_used = 0;
+    instruction_count = write_back_count = load_store_count = 0;
+    cosim_checked = 0;
+    cosim_diverged = false;
+    cosim_last_addr = 0;
+    cosim_access = false;
+    commit_count = 0;
+    sample_start_time = sample_end_time = 0;
+    sweep_pc_reached = false;
+#ifdef SIM_SAVABLE
+    quiet_state.clear();
+#endif
+    quiet_compares = 0;
+    skipped_cycles = 0;
+
+    open_series();
+    load_program();
+}
 
-template <typename T>
-static constexpr bool is_string_type = std::is_same<
-    std::remove_cv_t<std::remove_pointer_t<std::remove_reference_t<T>>>, char
->::value;
+void Simulation::run()
+{
+    top->clk = 0;
+    top->rst_n = 0;
+    memory_driver->drive_reset();
+#ifdef SIM_SAVABLE
+    if (restore_file)
+        restore_checkpoint(restore_file);
+#endif
+
+    stream_checker.start();
+    auto const host_start = std::chrono::steady_clock::now();
+    // done still shows the last program's until a reloaded core is reset
+    while (!(top->rst_n && top->done) && !sample_end_time && !(interrupt && main_time >= stop_time))
+    {
+        top->clk = !top->clk; // Toggle clock
+        if (top->clk && quiesce)
+        {
+            cycle_stats.clear();
+            cycle_active = axi_handshake();
+        }
+        if (top->clk)
+        {
+            HostTimer timer(host, HOST_MEMORY_DRIVER);
+            memory_driver->consume(main_time);
+        }
+        if (main_time == 100)
+            top->rst_n = 1; // Deassert reset
+        {
+            HostTimer timer(host, HOST_EVAL);
+            top->eval();        // Evaluate model
+        }
+        if (wave_spec.stat < 0 && !wave_spec.stat_name.empty())
+            resolve_wave_stat(); // the initial blocks have registered the counters
+        if (top->clk)
+        {
+            {
+                HostTimer timer(host, HOST_MEMORY_DRIVER);
+                memory_driver->drive(main_time);
+            }
+            HostTimer timer(host, HOST_MEMORY);
+            memory->process(main_time);
+        }
+      //  if (main_time % 1000000 == 0)
+        //    std::cout << "Time is now: " << main_time << std::endl;
+        if (tfp)
+        {
+            HostTimer timer(host, HOST_WAVES);
+            update_wave();
+            if (tfp->isOpen())
+                tfp->dump(main_time);
+        }
 
-static constexpr const char* stage_name_table[] = {
-    "Fetch",
-    "Decode",
-    "Rename",
-    "Issue",
-    "Commit",
-};
+        main_time += 5; // Time passes...
 
-struct hex {
-    int value;
-    
-    friend std::ostream& operator<<(std::ostream& os, const hex& hex) {
-        return os << '"' << std::hex << std::setw(8) << std::setfill('0')
-                  << hex.value << '"' << std::dec;
-    }
-};
+#ifdef SIM_SAVABLE
+        if (quiesce && !top->clk && top->rst_n && !interrupt && !(tfp && tfp->isOpen()))
+            skip_quiescent();
+#endif
 
-struct PhysReg {
-    int index;
+        if (series && main_time >= series_time + series_interval * 10)
+            sample_series();
 
-    // This is needed so that we are able to
-    // use the least significant bit as a 'use' flag
-    PhysReg adjust(int n) {
-        return { index >> n };
-    }
-    
-    friend std::ostream& operator<<(std::ostream& os, const PhysReg& reg) {
-        return os << "\"p" << reg.index << '\"';
-    }
-};
+        if (at_sweep_point())
+            run_sweep();
 
-template <typename T>
-struct Trace_Entry {
-    char const* key;
-    T value;
-    bool visible;
-};
+#ifdef SIM_SAVABLE
+        if (checkpoint_cycle && main_time == checkpoint_cycle * 10)
+            save_checkpoint(benchmark + "." + std::to_string(checkpoint_cycle) + ".ckpt");
+#endif
 
-template <typename T>
-Trace_Entry<T> make_entry(char const* key, T const& value, bool visible = true) {
-    return {key, value, visible};
-}
-
-struct Tracer {
-    std::ofstream f;
-    int event_count = 0;
-    int json_fragment = 0; // only output a JSON fragment
-    void create() {
-        if (output_trace) f.open(std::string(output_trace) + ".json");
-        if (!json_fragment) f << R"({"otherData":{},"traceEvents": [)";
-        for (auto&& stage: stage_name_table) {
-            f << R"({"cat":"a","dur":1,"name":"DUMMY","ph":"X","pid":")" << output_trace << R"(","tid":")" << stage << R"(","ts":0},)";
-        }
-    }
-    void destroy() {
-        if (!f.is_open()) return;
-        f.seekp(-1, std::ios_base::cur); // delete last ',' (assumes >0 events)
-        f << ' ';
-        if (!json_fragment) f << "]}";
-        f.close();
-        std::cout << "Wrote trace to \"" << output_trace << ".json\"\n";
-    }
-    template <typename...P>
-    void add_json_trace_event(char const* thread, char const* name, uint64_t ts, uint64_t duration, P&&...args) {
-        if (event_count >= 100'000) return;
-        f << R"({"cat":"write","dur":)" << duration << R"(,"name":")"
-          << name
-          << R"(","ph":"X","pid":")"
-          << output_trace
-          << R"(","tid":")"
-          << thread
-          << R"(","ts":)"
-          << T(ts);
-        if (sizeof...(P) > 0) {
-            f << R"(,"args":{)";
-            add_json_trace_event_args(std::forward<P>(args)...);
-            f << R"(}},)";
-        }
-        event_count++;
-    }
-
-    template <typename T>
-    bool add_json_trace_event_args(Trace_Entry<T> const& entry) {
-        if (!entry.visible) return false;
-        f << '\"' << entry.key << "\":";
-        if (is_string_type<T>) f << '"';
-        f << entry.value;
-        if (is_string_type<T>) f << '"';
-        return true;
-    }
-
-    template <typename T, typename...P>
-    void add_json_trace_event_args(Trace_Entry<T> const& entry, P&&...rest) {
-       if (add_json_trace_event_args(entry)) f << ',';
-       add_json_trace_event_args(std::forward<P>(rest)...);
+        if (signal_received && !interrupt)
+            interrupt = signal_received;
+        if (interrupt && stop_time == 0)
+        {
+            stop_time = main_time + 100;
+            err << "\n!! Interrupt raised at time=" << main_time << std::endl
+                << "!! Running additional 10 cycles before terminating at stop_time=" << stop_time << std::endl;
+        }
     }
 
-};
-
-Tracer tracer;
-
-void btb_event (int btb_hit){
-    if(btb_hit==1){
-        ::total_btb_used++;
+    stream_checker.stop(); // any mismatch is reported before the summary
+    if (sweep_pipe >= 0)
+    {
+        SweepResult const result {
+            CYCLES(main_time - sweep_start_time),
+            instruction_count - sweep_start_instructions,
+            interrupt != 0
+        };
+        if (write(sweep_pipe, &result, sizeof(result)) != sizeof(result))
+            perror("write");
+        _exit(0);
     }
+    if (!sweep_configs.empty())
+        err << "\n!! The sweep point was never reached" << std::endl;
+    host_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - host_start).count();
 }
 
-void predictor_event (int prediction, int correct){
-    if(prediction==correct){
-        ::correct++;
+void Simulation::report()
+{
+    int cycle_count = main_time / 10;
+    out << std::dec
+        << "\n\nTotal time: " << main_time
+        << "\nCycle count: " << cycle_count
+        << "\nInstruction count: " << instruction_count
+        << "\nCPI: " << (float)cycle_count / instruction_count << " IPC: " << (float)instruction_count / cycle_count << std::endl;
+
+    out << "\n== Stats ===============\n";
+
+    {
+        std::lock_guard<std::mutex> lock(stat_names_mutex);
+        for (size_t i = 0; i < stat_names.size(); i++)
+            out << stat_names[i] << ": " << (i < stats.size() ? stats[i] : 0) << std::endl;
     }
-    ::prediction++;
-    //std::cout << "hi" << std::endl;
-}
 
-typedef struct {
-    int type;
-    union {
-        struct {
-            int a, b, c, d, e, f;
-        } _input;
-
-        struct {
-            hex pc;
-            int raw_instruction;
-        } fetch;
-
-        struct {
-            hex pc;
-            Instruction ins;
-            Register rw, rs, rt;
-            int imm;
-        } decode;
-
-        struct {
-            hex pc;
-            int commit_index;
-            PhysReg old; // old mapping for rw
-            PhysReg dst;
-            PhysReg src1;
-            PhysReg src2;
-        } rename;
-
-        struct {
-            hex pc;
-            int commit_index;
-            int result, outcome;
-        } issue;
-
-        struct {
-            hex pc;
-            int commit_index;
-            PhysReg dst, free;
-        } commit;
-    };
-} Pipeline_Stage_Event;
+    out << "branch predicted correctly: " << correct << std::endl;
+    out << "branch: " << prediction << std::endl;
 
-static_assert(sizeof(Pipeline_Stage_Event) == sizeof(int) * 7);
+    out << "btb hits: " << total_btb_used << std::endl;
+    memory->report_footprint(out, memory_debug > 0);
+    if (iss)
+        out << "co-simulation: " << cosim_checked << " instructions matched"
+            << (cosim_diverged ? " before diverging" : "") << std::endl;
 
-int debug_level() {
-    //if (CYCLES(main_time) < 12607) return 0;
-    return _debug_level;
-}
+    report_occupancy();
 
-const char* alu_ctl_to_string(int alu_ctl) {
-    auto op = ALU_Operation(alu_ctl);
-    return to_string(op);
-}
+    if (sample_warmup || sample_length)
+    {
+        // A sample cut short by the end of the program is measured up to it
+        vluint64_t const end = sample_end_time ? sample_end_time : main_time;
+        uint64_t const measured = commit_count > sample_warmup ? commit_count - sample_warmup : 0;
+        uint64_t const sample_cycles = CYCLES(end - sample_start_time);
+        out << "\n== Sample ==============\n"
+            << "Sample instructions: " << measured
+            << "\nSample cycles: " << sample_cycles
+            << "\nSample CPI: " << (double)sample_cycles / measured << std::endl;
+    }
 
-const char* mips_reg_to_string(int index) {
-    auto reg = Register(index);
-    return to_string(reg);
-}
+    out << "\n== Host ================\n"
+        << "Threads: " << contextp->threads()
+        << "\nHost time: " << host_seconds << " s"
+        << "\nSimulation speed: " << std::fixed << std::setprecision(0)
+        << cycle_count / host_seconds << " cycles/s" << std::defaultfloat << std::endl;
+    if (quiesce)
+        out << "Skipped cycles: " << skipped_cycles << " ("
+            << std::fixed << std::setprecision(1) << 100.0 * skipped_cycles / cycle_count << "%)"
+            << std::defaultfloat << std::endl;
+    if (host_profile)
+        report_host_profile();
 
-void log_pipeline_stage(int stage,
-    int a, int b, int c, int d, int e, int f
-) {
-    if (!output_trace) return;
-    
-    Pipeline_Stage_Event ev = {
-        .type = stage,
-        ._input = { a, b, c, d, e, f }
-    };
+    if (interrupt)
+        err << "\n== ABORTED =============\nSimulation aborted at stop_time=" << main_time << std::endl;
 
-    char buffer[32] = {};
-    auto stage_name = stage_name_table[stage];
-
-    switch (stage) {
-        default: break;
-        case 0: {
-            auto info = ev.fetch;
-            tracer.add_json_trace_event(
-                stage_name,
-                "F",
-                main_time,
-                DURATION,
-                make_entry("pc", info.pc),
-                make_entry("raw_instruction", hex{info.raw_instruction})
-            );
-            break;
-        }
-        case 1: {
-            auto info = ev.decode;
-            tracer.add_json_trace_event(
-                stage_name,
-                to_string(info.ins),
-                main_time,
-                DURATION,
-                make_entry("pc", info.pc),
-                make_entry("rw", to_string(info.rw)),
-                make_entry("rs", to_string(info.rs)),
-                make_entry("rt", to_string(info.rt)),
-                make_entry("imm", info.imm)
-            );
-            break;
-        }
-        case 2: {
-            auto info = ev.rename;
-
-            if (info.dst.index & 1) // valid?
-                snprintf(buffer, sizeof(buffer), "p%i", info.dst.adjust(1).index);
-            else
-                snprintf(buffer, sizeof(buffer), "I");
-
-            tracer.add_json_trace_event(
-                stage_name,
-                buffer,
-                main_time,
-                DURATION,
-                make_entry("pc", info.pc),
-                make_entry("Commit Index", info.commit_index),
-                make_entry("src1", info.src1.adjust(1), info.src1.index & 1),
-                make_entry("src2", info.src2.adjust(1), info.src2.index & 1),
-                make_entry("old", info.old)
-            //  make_entry("dst", info.dst)
-            );
-            break;
-        }
-        case 3: {
-            auto info = ev.issue;
-            snprintf(buffer, sizeof(buffer), "C%i", info.commit_index);
-            tracer.add_json_trace_event(
-                stage_name,
-                buffer,
-                main_time,
-                DURATION,
-                make_entry("pc", info.pc),
-                make_entry("Commit Index", info.commit_index),
-                make_entry("result", info.result),
-                make_entry("outcome", info.outcome)
-            );
-            break;
-        }
-        case 4: {
-            auto info = ev.commit;
-            snprintf(buffer, sizeof(buffer), "C%i", info.commit_index);
-            tracer.add_json_trace_event(
-                stage_name,
-                buffer,
-                main_time,
-                DURATION,
-                make_entry("pc", info.pc),
-                make_entry("dst",  info.dst.adjust(1), info.dst.index & 1),
-                make_entry("free", info.free.adjust(1), info.free.index & 1),
-                make_entry("Commit Index", info.commit_index)
-            );
-            break;
-        }
-    }
-}
-
-void stats_event(const char *e) {
-    std::string s(e);
-    stats[s]++;
-}
-
-unsigned int instruction_count = 0;
+    if (tfp && tfp->isOpen())
+        tfp->close();
+    tracer.close(&out);
+    kanata.close(&out);
+    close_series();
+    if (pc_profile && profile.write(benchmark + ".profile", hexfiles_dir + "/hexfiles/" + benchmark + ".dis"))
+        out << "Wrote cycle profile to \"" << benchmark << ".profile\"" << std::endl;
+    if (latency_profile && latency.write(benchmark + ".latency"))
+        out << "Wrote latency histograms to \"" << benchmark << ".latency\"" << std::endl;
+    pc_stream.close();
+    wb_stream.close();
+    ls_stream.close();
+}
 
-void pc_event(const int pc)
+// Each gauge's occupancy over the run: mean, percentiles and cycles spent
+// full, the cycles its <NAME>_stall counter says it held something up,
+// then the share of cycles in each eighth of the capacity
+void Simulation::report_occupancy()
 {
-    if (stream_print)
-        std::cout << "-- EVENT pc=" << std::hex << pc << std::endl;
-    if (stream_dump)
+    std::vector<StatGauge> gauges;
     {
-        std::string fname(hexfiles_dir + "/hexfiles/"+ std::string(benchmark) +".pc.txt");
-        static std::ofstream f(fname);
-        if (!f.is_open())
-        {
-            std::cerr << "Failed to open file: " << fname << std::endl;
-            exit(-1);
-        }
-        if (stream_dump >= 2)
-            f << std::dec << main_time << " ";
-        f << std::hex << pc << std::endl;
+        std::lock_guard<std::mutex> lock(stat_names_mutex);
+        gauges = stat_gauges;
     }
-    if (stream_check)
+    if (gauges.empty())
+        return;
+
+    out << "\n== Occupancy ===========\n"
+        << std::setw(30) << std::left << "structure" << std::right << std::setw(6) << "size"
+        << std::setw(9) << "mean" << std::setw(6) << "p50" << std::setw(6) << "p90"
+        << std::setw(6) << "max" << std::setw(9) << "full" << std::setw(12) << "stalls" << "\n";
+    std::ostringstream buckets;
+    buckets << std::fixed << std::setprecision(1);
+    for (size_t i = 0; i < gauges.size(); i++)
     {
-        std::string fname(hexfiles_dir + "/hexfiles/"+ std::string(benchmark) +".pc.txt");
-        static std::ifstream f(fname);
-        if (!f.is_open())
-        {
-            std::cerr << "Failed to open file: " << fname << std::endl;
-            exit(-1);
-        }
-
-        unsigned int expected_pc;
-        if (!(f >> std::hex >> expected_pc))
+        if (i >= gauge_histograms.size())
+            break;
+        const std::vector<uint64_t> &histogram = gauge_histograms[i];
+        uint64_t cycles = 0, sum = 0;
+        for (size_t level = 0; level < histogram.size(); level++)
         {
-            std::cout << "\n!! Ran out of expected pc."
-                         "\n!! More instructions are executed than expected"
-                         "\n!! Additional pc="
-                      << std::hex << pc << std::endl;
-            std::raise(SIGINT);
+            cycles += histogram[level];
+            sum += histogram[level] * level;
         }
-        else if (expected_pc != pc)
+        if (!cycles)
+            continue;
+        auto const percentile = [&](double p) {
+            size_t level = 0;
+            uint64_t seen = histogram[0];
+            while (level + 1 < histogram.size() && seen < p * cycles)
+                seen += histogram[++level];
+            return level;
+        };
+        size_t max = histogram.size() - 1;
+        while (max && !histogram[max])
+            max--;
+        unsigned const stall = stats_find((gauges[i].name + "_stall").c_str());
+
+        out << std::setw(30) << std::left << gauges[i].name << std::right << std::setw(6) << gauges[i].capacity
+            << std::setw(9) << std::fixed << std::setprecision(2) << double(sum) / cycles
+            << std::setw(6) << percentile(0.5) << std::setw(6) << percentile(0.9) << std::setw(6) << max
+            << std::setw(8) << std::setprecision(1) << 100.0 * histogram.back() / cycles << "%"
+            << std::setw(12) << (stall < stats.size() ? stats[stall] : 0) << std::defaultfloat << "\n";
+
+        buckets << gauges[i].name << ":";
+        size_t const width = std::max<size_t>(1, histogram.size() / 8);
+        for (size_t low = 0; low < histogram.size(); low += width)
         {
-            std::cout << "\n!! [" << std::dec << main_time << "] expected_pc=" << std::hex << expected_pc
-                      << " mismatches pc=" << pc << std::endl;
-            std::raise(SIGINT);
+            size_t const high = std::min(low + width, histogram.size()) - 1;
+            uint64_t in = 0;
+            for (size_t level = low; level <= high; level++)
+                in += histogram[level];
+            buckets << " " << low;
+            if (high != low)
+                buckets << "-" << high;
+            buckets << " " << 100.0 * in / cycles << "%";
         }
+        buckets << "\n";
     }
-    instruction_count++;
+    out << buckets.str();
 }
 
-unsigned int write_back_count = 0;
-
-void wb_event(const int addr, const int data)
+// Host time by component over the run loop, per simulated cycle. With
+// asynchronous streams the checking runs on its own thread, beside the
+// loop rather than in it; whatever no timer covers is the loop itself.
+void Simulation::report_host_profile()
 {
-    if (stream_print)
-        std::cout << "-- EVENT wb addr=" << std::hex << addr
-                  << " data=" << data << std::endl;
-    if (stream_dump)
+    uint64_t const cycles = std::max<uint64_t>(1, main_time / 10);
+    double const loop_ns = host_seconds * 1e9;
+    bool const streams_aside = stream_async && stream_checker.enabled();
+    double rest = loop_ns;
+
+    out << "\n== Host profile ========\n"
+        << "Simulated: " << std::fixed << std::setprecision(1) << cycles / host_seconds / 1e3 << " kHz\n"
+        << std::setw(26) << std::left << "component" << std::right << std::setw(14) << "calls"
+        << std::setw(12) << "seconds" << std::setw(12) << "ns/cycle" << std::setw(8) << "%" << "\n";
+    auto const row = [&](const std::string &name, uint64_t calls, double ns) {
+        out << std::setw(26) << std::left << name << std::right << std::setw(14) << calls
+            << std::setw(12) << std::setprecision(3) << ns / 1e9
+            << std::setw(12) << std::setprecision(1) << ns / cycles
+            << std::setw(7) << 100.0 * ns / loop_ns << "%\n";
+    };
+    for (unsigned c = 0; c < HOST_COMPONENTS; c++)
     {
-        std::string fname(hexfiles_dir + "/hexfiles/"+ std::string(benchmark) +".wb.txt");
-        static std::ofstream f(fname);
-        if (!f.is_open())
-        {
-            std::cerr << "Failed to open file: " << fname << std::endl;
-            exit(-1);
-        }
-        if (stream_dump >= 2)
-            f << std::dec << main_time << " ";
-        f << std::hex << addr << " " << data << std::endl;
+        if (c == HOST_STREAMS && streams_aside)
+            continue;
+        row(host_component_names[c], host.calls[c], host.ns[c]);
+        rest -= host.ns[c];
     }
-    if (stream_check)
+    row("harness", main_time / 5, std::max(0.0, rest)); // once per clock edge
+    if (streams_aside)
+        row(std::string(host_component_names[HOST_STREAMS]) + " (thread)", host.calls[HOST_STREAMS], host.ns[HOST_STREAMS]);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    out << "Peak RSS: " << usage.ru_maxrss / 1024.0 << " MB (whole process)" << std::defaultfloat << std::endl;
+}
+
+RunResult Simulation::result() const
+{
+    auto const stat = [this](const std::string &name) {
+        unsigned const handle = stats_find(name.c_str());
+        return handle < stats.size() ? stats[handle] : 0;
+    };
+    RunResult r {
+        benchmark,
+        unsigned(main_time / 10),
+        instruction_count,
+        int(stat("br_miss")),
+        int(stat("ic_miss")),
+        correct,
+        prediction,
+        {},
+        interrupt != 0,
+        ""
+    };
+    for (unsigned c = 0; c < CPI_CATEGORIES; c++)
+        r.cpi_stack[c] = stat(std::string("cpi_") + cpi_categories[c]);
+    return r;
+}
+
+void print_table_header()
+{
+    printf("%10s %12s %20s %13s %13s %12s %12s %20s %20s\n",
+        "Benchmark",
+        "Cycle count",
+        "Instruction count",
+        "CPI",
+        "IPC",
+        "br_miss",
+        "ic_miss",
+        "correct prediction",
+        "total branch"
+    );
+}
+
+void print_table_row(const RunResult &r)
+{
+    printf("%10s %12u %20u %13f %13f %12d %12d %20d %20d\n",
+        r.benchmark.c_str(),
+        r.cycles,
+        r.instructions,
+        (float)r.cycles / r.instructions,
+        (float)r.instructions / r.cycles,
+        r.br_miss,
+        r.ic_miss,
+        r.correct,
+        r.prediction
+    );
+}
+
+// Cycles per instruction by what held up commit. Every cycle from reset on
+// is charged to one category, so they sum to the CPI.
+void print_cpi_stack(const std::vector<RunResult> &results)
+{
+    printf("\n%10s %13s", "CPI stack", "CPI");
+    for (const char *name : cpi_categories)
+        printf(" %10s", name);
+    printf("\n");
+    for (const RunResult &r : results)
     {
-        std::string fname(hexfiles_dir + "/hexfiles/"+ std::string(benchmark) +".wb.txt");
-        static std::ifstream f(fname);
-        if (!f.is_open())
-        {
-            std::cerr << "Failed to open file: " << fname << std::endl;
-            exit(-1);
-        }
+        printf("%10s %13f", r.benchmark.c_str(), (float)r.cycles / r.instructions);
+        for (uint64_t cycles : r.cpi_stack)
+            printf(" %10.4f", (float)cycles / r.instructions);
+        printf("\n");
+    }
+}
 
-        unsigned int expected_addr, expected_data;
-        if (!(f >> std::hex >> expected_addr >> expected_data))
-        {
-            std::cout << "\n!! Ran out of expected write back."
-                         "\n!! More write back are executed than expected"
-                         "\n!! Additional write back addr="
-                      << std::hex << addr << " data=" << data << std::endl;
-            std::raise(SIGINT);
-        }
-        else if (expected_addr != addr || expected_data != data)
+Simulation::~Simulation()
+{
+    stream_checker.stop();
+    if (top)
+        top->final(); // Done simulating
+    delete memory_driver;
+    delete top;
+    delete contextp;
+    delete tfp;
+    delete iss;
+    delete memory;
+}
+
+// Run each benchmark on its own model, parallel_runs at a time, and print
+// the reports in order followed by one table. With reuse_model every pool
+// thread builds one model and reloads it for each benchmark it takes.
+int run_benchmarks(const std::vector<std::string> &names, int argc, char **argv)
+{
+    std::vector<RunResult> results(names.size());
+    std::atomic<size_t> next {0};
+    auto const worker = [&]() {
+        std::ostringstream report;
+        std::unique_ptr<Simulation> sim;
+        for (size_t i; (i = next++) < names.size();)
         {
-            std::cout << "\n!! [" << std::dec << main_time << "] expected write back mismatches"
-                      << "\n!! [" << std::dec << main_time << "] expected addr=" << std::hex << expected_addr
-                      << " data=" << expected_data
-                      << "\n!! [" << std::dec << main_time << "] actual   addr=" << std::hex << addr
-                      << " data=" << data << std::endl;
-            std::raise(SIGINT);
+            if (sim && reuse_model)
+                sim->reload(names[i]);
+            else
+            {
+                sim.reset(new Simulation(names[i], report, report));
+                current = sim.get();
+                sim->setup(argc, argv);
+                if (sim->contextp->threads() > 1)
+                {
+                    std::cerr << "Several benchmarks at once need a single threaded model (make verilate)" << std::endl;
+                    exit(-1);
+                }
+            }
+            sim->run();
+            sim->report();
+            results[i] = sim->result();
+            results[i].report = report.str();
+            report.str("");
         }
+        sim.reset();
+        current = nullptr;
+    };
+
+    unsigned pool = parallel_runs ? parallel_runs : std::thread::hardware_concurrency();
+    pool = std::max(1u, std::min<unsigned>(pool, names.size()));
+    auto const host_start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < pool; i++)
+        threads.emplace_back(worker);
+    for (std::thread &thread : threads)
+        thread.join();
+    double const host_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - host_start).count();
+
+    int aborted = 0;
+    for (const RunResult &r : results)
+    {
+        std::cout << "\n== " << r.benchmark << " ==" << r.report;
+        aborted += r.aborted;
     }
-    write_back_count++;
+    std::cout << "\n" << results.size() << " benchmarks on " << pool << (reuse_model ? " reused models" : " threads")
+              << " in " << host_seconds << " s"
+              << (aborted ? ", " + std::to_string(aborted) + " aborted" : "") << "\n" << std::endl;
+
+    print_table_header();
+    for (const RunResult &r : results)
+        print_table_row(r);
+    print_cpi_stack(results);
+    return aborted ? -1 : 0;
 }
 
-unsigned int load_store_count = 0;
-void ls_event(const int op, const int addr, const int data)
+// Benchmarks named by a -b entry: itself, or with wildcards (test_*) every
+// program image in hexfiles/ that matches
+void expand_benchmarks(const std::string &pattern, std::vector<std::string> &names)
 {
-    if (stream_print)
-        std::cout << "-- EVENT ls op=" << std::hex << op
-                  << " addr=" << addr
-                  << " data=" << data << std::endl;
-    if (stream_dump)
+    if (pattern.find_first_of("*?[") == std::string::npos)
     {
-        std::string fname(hexfiles_dir + "/hexfiles/"+ std::string(benchmark) +".ls.txt");
-        static std::ofstream f(fname);
-        if (!f.is_open())
-        {
-            std::cerr << "Failed to open file: " << fname << std::endl;
-            exit(-1);
-        }
-        if (stream_dump >= 2)
-            f << std::dec << main_time << " ";
-        f << std::hex << op << " " << addr << " " << data << std::endl;
+        names.push_back(pattern);
+        return;
     }
-    if (stream_check)
+    std::string const dir(hexfiles_dir + "/hexfiles/");
+    std::set<std::string> found;
+    for (auto ext : {".out", ".bin", ".hex"})
     {
-        std::string fname(hexfiles_dir + "/hexfiles/"+ std::string(benchmark) +".ls.txt");
-        static std::ifstream f(fname);
-        if (!f.is_open())
+        glob_t g;
+        if (glob((dir + pattern + ext).c_str(), 0, NULL, &g) == 0)
         {
-            std::cerr << "Failed to open file: " << fname << std::endl;
-            exit(-1);
-        }
-
-        unsigned int expected_op, expected_addr, expected_data;
-        if (!(f >> std::hex >> expected_op && f >> expected_addr && f >> expected_data))
-        {
-            std::cout << "\n!! Ran out of expected load store"
-                         "\n!! More load store are executed than expected"
-                         "\n!! Additional load store op="
-                      << std::hex << op << " addr=" << addr << " data=" << data << std::endl;
-            std::raise(SIGINT);
-        }
-        else if (expected_op != op || expected_addr != addr || expected_data != data)
-        {
-            std::cout << "\n!! [" << std::dec << main_time << "] expected load store mismatches"
-                      << "\n!! [" << std::dec << main_time << "] expected op=" << std::hex << expected_op
-                      << " addr=" << expected_addr
-                      << " data=" << expected_data
-                      << "\n!! [" << std::dec << main_time << "] actual   op=" << std::hex << op
-                      << " addr=" << addr
-                      << " data=" << data << std::endl;
-            std::raise(SIGINT);
+            for (size_t i = 0; i < g.gl_pathc; i++)
+            {
+                std::string const path(g.gl_pathv[i]);
+                found.insert(path.substr(dir.size(), path.size() - dir.size() - strlen(ext)));
+            }
         }
+        globfree(&g);
     }
-
-    load_store_count++;
+    names.insert(names.end(), found.begin(), found.end());
 }
 
 int main(int argc, char **argv)
 {
-    std::signal(SIGINT, signal_handler);
+    std::signal(SIGINT, on_signal);
 
     int opt;
-    int dump = 0;
-    double memory_delay_factor = 1.0;
-    while ((opt = getopt(argc, argv, "dmpstf:b:o:l:")) != -1)
+    while ((opt = getopt(argc, argv, "AcdLmPpqrsStf:b:o:O:k:l:j:i:D:F:w:N:C:R:W:X:T:I:")) != -1)
     {
         switch (opt)
         {
+        case 'c':
+            // Check every commit against the ISS instead of golden traces
+            cosim = 1;
+            stream_check = 0;
+            break;
         case 'd':
             // Dump verilog waves to simx.fst
-            dump = 1;
+            wave_dump = 1;
+            break;
+        case 'D':
+            // Dump a window of them, e.g. cycles:20000-21000 or
+            // pc:80001c,length:500,scope:TOP.mips_core.FETCH_UNIT
+            if (!parse_wave_spec(optarg))
+            {
+                std::cerr << "Bad waveform window: " << optarg << std::endl;
+                return -1;
+            }
+            wave_dump = 1;
             break;
         case 'm':
             // Print debug info for cpp memory model
@@ -524,10 +2129,24 @@ int main(int argc, char **argv)
             // Print stream events to stdout
             stream_print = 1;
             break;
+        case 'q':
+            // Skip the cycles in which a stalled core waits on memory
+            quiesce = 1;
+            break;
+        case 'r':
+            // Run the benchmarks of -b back to back on one model per
+            // thread, resetting it and swapping the memory image between them
+            reuse_model = 1;
+            break;
         case 's':
             // Skip stream checks
             stream_check = 0;
             break;
+        case 'S':
+            // Print/check streams synchronously inside the DPI calls,
+            // e.g. to keep -p output in order with $display
+            stream_async = 0;
+            break;
         case 't':
             // Trace streams and save to files
             // Repeat to include time in the trace
@@ -541,126 +2160,196 @@ int main(int argc, char **argv)
             }
             break;
         case 'b':
-            benchmark = optarg;
+            // One benchmark, or a comma separated list to run in parallel;
+            // wildcards match the images in hexfiles/ (-b 'test_*')
+            benchmarks = optarg;
             break;
         case 'o':
+            // Write pipeline stage events to <FILE>.pftrace (Perfetto)
             output_trace = optarg;
             break;
+        case 'O':
+            // Keep only some of them, e.g. pc:400-4ff,cycles:1000-2000,
+            // stages:IC; rotate:<MB> starts a new file every MB
+            if (!trace_filter.parse(optarg))
+            {
+                std::cerr << "Bad trace filter: " << optarg << std::endl;
+                return -1;
+            }
+            break;
+        case 'A':
+            // Charge every cycle to the instruction at the head of the
+            // commit queue, with why it waits; writes <BENCHMARK>.profile
+            pc_profile = 1;
+            break;
+        case 'L':
+            // Histograms of how long each committed instruction waited to
+            // issue, executed and waited to commit, by class; writes
+            // <BENCHMARK>.latency
+            latency_profile = 1;
+            break;
+        case 'P':
+            // Time the parts of the simulator itself: eval, the memory
+            // model, DPI hooks, stream checking and waveforms
+            host_profile = 1;
+            break;
+        case 'k':
+            // Write a Kanata log of every instruction, flushed ones
+            // included, for the Konata pipeline viewer
+            kanata_file = optarg;
+            break;
+        case 'i':
+            memory_image = optarg;
+            break;
         case 'l':
             _debug_level = std::stoi(optarg);
             break;
+        case 'F':
+            // Run this many instructions on the ISS before the RTL starts
+            // (golden traces start at the first instruction, so skip them)
+            fast_forward = std::stoull(optarg);
+            stream_check = 0;
+            break;
+        case 'w':
+            // Commits simulated in detail before the sample is measured
+            sample_warmup = std::stoull(optarg);
+            break;
+        case 'N':
+            // Stop once this many commits after the warm-up are measured
+            sample_length = std::stoull(optarg);
+            break;
+        case 'C':
+            // Save a checkpoint to <BENCHMARK>.<CYCLE>.ckpt at this cycle
+            checkpoint_cycle = std::stoull(optarg);
+            break;
+        case 'R':
+            // Resume from a checkpoint instead of reset
+            restore_file = optarg;
+            break;
+        case 'W':
+            // Sweep point: a cycle, or pc:<PC> for the first commit of PC
+            if (!parse_sweep_point(optarg))
+            {
+                std::cerr << "Bad sweep point: " << optarg << std::endl;
+                return -1;
+            }
+            break;
+        case 'X':
+            // Memory configurations to sweep, <FACTOR>[/<READS>/<WRITES>],...
+            if (!parse_sweep_configs(optarg))
+            {
+                std::cerr << "Bad sweep configurations: " << optarg << std::endl;
+                return -1;
+            }
+            break;
+        case 'I':
+            // Sample counters and queue levels every CYCLES cycles into
+            // <BENCHMARK>.series.csv, or FILE (*.bin for raw binary)
+            {
+                char *end = nullptr;
+                series_interval = strtoull(optarg, &end, 10);
+                if (series_interval && *end == ',' && end[1])
+                    series_file = end + 1;
+                else if (*end || series_interval == 0)
+                {
+                    std::cerr << "Bad sample interval: " << optarg << std::endl;
+                    return -1;
+                }
+            }
+            break;
+        case 'j':
+            // Size of the model's thread pool, only useful when
+            // verilated with --threads (make verilate-mt)
+            sim_threads = std::stoi(optarg);
+            break;
+        case 'T':
+            // Benchmarks simulated at once with -b a,b,c
+            parallel_runs = std::stoi(optarg);
+            break;
         default: /* '?' */
-            std::cerr << "Usage: " << argv[0] << " [-dmpst] [-b benchmark] [+plusargs]" << std::endl;
+            std::cerr << "Usage: " << argv[0] << " [-AcdLmPpqrsSt] [-D window] [-o trace [-O filter]] [-k kanata_log] [-I cycles[,file]] [-b benchmark[,benchmark...]] [-T runs] [-j threads] [-F instructions] [-w warmup] [-N instructions] [-C cycle] [-R checkpoint] [-W point -X configs] [+plusargs]" << std::endl;
             return -1;
         }
     }
 
-    tracer.create(); // create trace if have output file
-    Verilated::commandArgs(argc, argv); // Remember args
-
-    top = new Vmips_core; // Create instance
-    std::string const hex_file_name (hexfiles_dir + "/hexfiles/" + std::string(benchmark) + ".hex");
-    memory = new Memory(hex_file_name.c_str(), memory_delay_factor);
-    memory_driver = new MemoryDriver(top, memory);
-
-    VerilatedFstC *tfp;
-    if (dump)
+#ifndef SIM_SAVABLE
+    if (checkpoint_cycle || restore_file)
     {
-        std::cout << "Dumping waveform to simx.fst\n";
-        Verilated::traceEverOn(true);
-        tfp = new VerilatedFstC;
-        top->trace(tfp, 1024);
-        tfp->open("simx.fst");
+        std::cerr << "Checkpoints need a model verilated with --savable (make verilate SAVABLE=1)" << std::endl;
+        return -1;
+    }
+    if (quiesce)
+    {
+        std::cerr << "-q compares the model's checkpoint state, so it needs a model verilated with --savable (make verilate SAVABLE=1)" << std::endl;
+        return -1;
+    }
+#endif
+    if (restore_file && fast_forward)
+    {
+        std::cerr << "-R and -F both set the starting state, use one" << std::endl;
+        return -1;
     }
 
-    top->clk = 0;
-    top->rst_n = 0;
-    memory_driver->drive_reset();
-
-    while (!top->done && !(interrupt && main_time >= stop_time))
+    if (quiesce && ((wave_dump && !wave_spec.triggered()) || _debug_level))
     {
-        top->clk = !top->clk; // Toggle clock
-        if (top->clk)
-            memory_driver->consume(main_time);
-        if (main_time == 100)
-            top->rst_n = 1; // Deassert reset
-        top->eval();        // Evaluate model
-        if (top->clk)
-        {
-            memory_driver->drive(main_time);
-            memory->process(main_time);
-        }
-      //  if (main_time % 1000000 == 0)
-        //    std::cout << "Time is now: " << main_time << std::endl;
-        if (dump)
-            tfp->dump(main_time);
+        std::cerr << "-q skips cycles, which -d and -l would show (-D with a start condition is fine)" << std::endl;
+        return -1;
+    }
 
-        main_time += 5; // Time passes...
+    if (!sweep_configs.empty() && (sweep_cycle == 0 && sweep_pc < 0))
+    {
+        std::cerr << "-X needs a sweep point (-W)" << std::endl;
+        return -1;
+    }
 
-        if (interrupt && stop_time == 0)
+    std::vector<std::string> names;
+    {
+        std::stringstream list(benchmarks);
+        std::string name;
+        while (std::getline(list, name, ','))
         {
-            stop_time = main_time + 100;
-            std::cerr << "\n!! Interrupt raised at time=" << main_time << std::endl
-                      << "!! Running additional 10 cycles before terminating at stop_time=" << stop_time << std::endl;
+            if (!name.empty())
+                expand_benchmarks(name, names);
         }
     }
-
-    top->final(); // Done simulating
-    delete memory_driver;
-    delete top;
-
-    if (dump)
+    if (names.empty())
     {
-        tfp->close();
+        std::cerr << "No benchmark given (-b)" << std::endl;
+        return -1;
     }
 
-    int cycle_count = main_time / 10;
-    std::cout << std::dec
-              << "\n\nTotal time: " << main_time
-              << "\nCycle count: " << cycle_count
-              << "\nInstruction count: " << instruction_count
-              << "\nCPI: " << (float)cycle_count / instruction_count << " IPC: " << (float)instruction_count / cycle_count << std::endl;
-
-    std::cout << "\n== Stats ===============\n";
-
-    for (const auto &e : stats){
-        std::cout << e.first << ": " << e.second << std::endl;
+    if (names.size() > 1 || reuse_model)
+    {
+        // The DPI finds its simulation by thread, and the rest write to
+        // files every run would share
+        if (wave_dump || output_trace || kanata_file || memory_image || checkpoint_cycle || restore_file || !sweep_configs.empty() || sim_threads > 1 || series_file)
+        {
+            std::cerr << "-r or -b with several benchmarks cannot be combined with -d, -o, -k, -i, -C, -R, -W/-X, -j or -I with a file" << std::endl;
+            return -1;
+        }
+        // Each run already has a host thread; checking on it keeps the
+        // report of a run in one piece
+        stream_async = 0;
+        return run_benchmarks(names, argc, argv);
     }
-    
-    std::cout << "branch predicted correctly: " << correct << std::endl;
-    std::cout << "branch: " << prediction << std::endl;
 
-    std::cout << "btb hits: " << total_btb_used << std::endl;
+    Simulation *sim = new Simulation(names[0], std::cout, std::cerr);
+    primary = sim;
+    current = sim;
+    sim->setup(argc, argv);
 
-    if (interrupt)
-        std::cerr << "\n== ABORTED =============\nSimulation aborted at stop_time=" << main_time << std::endl;
-
-    tracer.destroy();
-
-    {
-        printf("%10s %12s %20s %13s %13s %12s %12s %20s %20s\n",
-            "Benchmark",
-            "Cycle count",
-            "Instruction count",
-            "CPI",
-            "IPC",
-            "br_miss",
-            "ic_miss",
-            "correct prediction",
-            "total branch"
-        );
-        printf("%10s %12u %20u %13f %13f %12d %12d %20d %20d\n",
-            benchmark,
-            cycle_count,
-            instruction_count,
-            (float)cycle_count / instruction_count,
-            (float)instruction_count / cycle_count,
-            stats["br_miss"],
-            stats["ic_miss"],
-            correct,
-            prediction
-        );
+    if (!sweep_configs.empty() && (wave_dump || sim->contextp->threads() > 1))
+    {
+        std::cerr << "Sweeps fork the simulator, which needs a single threaded model and no -d" << std::endl;
+        return -1;
     }
 
-    delete memory;
+    sim->run();
+    sim->report();
+    RunResult const result = sim->result();
+    print_table_header();
+    print_table_row(result);
+    print_cpi_stack({result});
+    delete sim;
+    return result.aborted ? -1 : 0;
 }